@@ -19,6 +19,9 @@ static const float fullscreen_bg[]         = {0.18, 0.2, 0.25, 1.0};
 // 1 means idle inhibitors will disable idle tracking even if it's surface isn't visible
 static const int bypass_surface_visibility = 0;
 
+// 1 lets the bar switch the status output to length-prefixed binary records, 0 always prints text
+static const int binarystatus              = 1;
+
 // LAYOUTS
 static void twoWindows(Monitor *m);
 
@@ -1,10 +1,14 @@
 // See LICENSE file for copyright and license details
+#include <errno.h>
+#include <fcntl.h>
 #include <libinput.h>
 #include <limits.h>
 #include <linux/input-event-codes.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
@@ -66,6 +70,9 @@
 enum { CurNormal, CurPressed, CurMove, CurResize }; /* cursor */
 enum { XDGShell, LayerShell }; /* client types */
 enum { LyrBg, LyrBottom, LyrTop, LyrOverlay, LyrTile, LyrFloat, LyrFS, LyrDragIcon, LyrBlock, NUM_LAYERS }; /* scene layers */
+enum { StatusText, StatusBinary }; /* status output formats */
+enum { StatusRecordMonitor = 1 }; /* binary status record kinds */
+enum { StatusSelected = 1, StatusHasClient = 2, StatusFullscreen = 4, StatusFloating = 8 }; /* binary status flags */
 
 #include "structs.h"
 
@@ -93,6 +100,8 @@ static void moveresize(unsigned int movementType);
 static void pointerfocus(Client *c, struct wlr_surface *surface,
 		double sx, double sy, uint32_t time);
 static void printstatus(void);
+static void printstatusrecord(Monitor *m, Client *c, unsigned int occ, unsigned int sel,
+		unsigned int urg);
 static void quit(void);
 static void rendermon(struct wl_listener *listener, void *data);
 static void resize(Client *c, struct wlr_box geo, int interact);
@@ -100,6 +109,7 @@ static void setfloating(Client *c, int floating);
 static void setfullscreen(Client *c, int fullscreen);
 static void setlayout(const Layout *newLayout);
 static void setmon(Client *c, Monitor *m, unsigned int newtags);
+static int statusreply(int fd, uint32_t mask, void *data);
 static void togglefloating(void);
 static void togglefullscreen(void);
 static void unlocksession(struct wl_listener *listener, void *data);
@@ -114,6 +124,8 @@ static struct wlr_scene_node *xytonode(double x, double y, struct wlr_surface **
 static bool ignoreNextKeyrelease = false;
 static const char *cursor_image = "left_ptr";
 static pid_t child_pid = -1;
+static int statusformat = StatusText;
+static struct wl_event_source *statusreplysource;
 static int locked;
 static void *exclusive_focus;
 static struct wl_display *dpy;
@@ -995,7 +1007,12 @@ void printstatus(void) {
 			if (c->isurgent)
 				urg |= c->tags;
 		}
-		if ((c = focustop(m))) {
+		c = focustop(m);
+		if (statusformat == StatusBinary) {
+			printstatusrecord(m, c, occ, c ? c->tags : 0, urg);
+			continue;
+		}
+		if (c) {
 			title = client_get_title(c);
 			appid = client_get_appid(c);
 			printf("%s title %s\n", m->wlr_output->name, title);
@@ -1019,6 +1036,60 @@ void printstatus(void) {
 	fflush(stdout);
 }
 
+/* writes one length-prefixed monitor snapshot, see somebar/src/status_protocol.hpp */
+void printstatusrecord(Monitor *m, Client *c, unsigned int occ, unsigned int sel,
+		unsigned int urg) {
+	const char *name = m->wlr_output->name;
+	const char *layout = m->lt[m->sellt]->symbol;
+	const char *title = c ? client_get_title(c) : NULL;
+	const char *appid = c ? client_get_appid(c) : NULL;
+	uint32_t hdr[11];
+
+	title = title ? title : "";
+	appid = appid ? appid : "";
+	hdr[1] = StatusRecordMonitor;
+	hdr[2] = occ;
+	hdr[3] = m->tagset[m->seltags];
+	hdr[4] = sel;
+	hdr[5] = urg;
+	hdr[6] = (m == selmon ? StatusSelected : 0) | (c ? StatusHasClient : 0)
+		| (c && c->isfullscreen ? StatusFullscreen : 0)
+		| (c && c->isfloating ? StatusFloating : 0);
+	hdr[7] = strlen(name);
+	hdr[8] = strlen(layout);
+	hdr[9] = strlen(title);
+	hdr[10] = strlen(appid);
+	hdr[0] = sizeof(hdr) - sizeof(hdr[0]) + hdr[7] + hdr[8] + hdr[9] + hdr[10];
+
+	fwrite(hdr, sizeof(hdr), 1, stdout);
+	fwrite(name, 1, hdr[7], stdout);
+	fwrite(layout, 1, hdr[8], stdout);
+	fwrite(title, 1, hdr[9], stdout);
+	fwrite(appid, 1, hdr[10], stdout);
+}
+
+int statusreply(int fd, uint32_t mask, void *data) {
+	/* the bar answers the formats offered in DWL_STATUS_FORMATS with a single line */
+	char buf[64];
+	ssize_t n = read(fd, buf, sizeof(buf) - 1);
+
+	if (n > 0) {
+		buf[n] = '\0';
+		if (statusformat == StatusText && !strcmp(buf, "binary 1\n")) {
+			/* switch at a line boundary; every byte after this line is a record */
+			fwrite("\0binary 1\n", 1, 10, stdout);
+			statusformat = StatusBinary;
+			printstatus();
+		}
+	}
+	if (n == 0 || (n < 0 && errno != EAGAIN) || (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))) {
+		wl_event_source_remove(statusreplysource);
+		statusreplysource = NULL;
+		close(fd);
+	}
+	return 0;
+}
+
 void quit(void) {
 	wl_display_terminate(dpy);
 }
@@ -1465,20 +1536,40 @@ static void rundwl(void) {
 
 	/* Now that the socket exists and the backend is started, run the startup command */
 	int piperw[2];
+	int replyrw[2] = {-1, -1};
 	if (pipe(piperw) < 0)
 		die("startup: pipe:");
+	if (binarystatus && pipe(replyrw) < 0)
+		die("startup: pipe:");
 	if ((child_pid = fork()) < 0)
 		die("startup: fork:");
 	if (child_pid == 0) {
 		dup2(piperw[0], STDIN_FILENO);
 		close(piperw[0]);
 		close(piperw[1]);
+		if (binarystatus) {
+			/* offer binary status records; the bar may accept them on fd 3 */
+			close(replyrw[0]);
+			if (replyrw[1] != 3) {
+				dup2(replyrw[1], 3);
+				close(replyrw[1]);
+			}
+			setenv("DWL_STATUS_FORMATS", "text binary1", 1);
+			setenv("DWL_STATUS_REPLY_FD", "3", 1);
+		}
 		execl("/bin/sh", "/bin/sh", "-c", "somebar", NULL);
 		die("startup: execl:");
 	}
 	dup2(piperw[1], STDOUT_FILENO);
 	close(piperw[1]);
 	close(piperw[0]);
+	if (binarystatus) {
+		close(replyrw[1]);
+		fcntl(replyrw[0], F_SETFD, FD_CLOEXEC);
+		fcntl(replyrw[0], F_SETFL, O_NONBLOCK);
+		statusreplysource = wl_event_loop_add_fd(wl_display_get_event_loop(dpy),
+				replyrw[0], WL_EVENT_READABLE, statusreply, NULL);
+	}
 
 	/* If nobody is reading the status output, don't terminate */
 	sigaction(SIGPIPE, &sa, NULL);
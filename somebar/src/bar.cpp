@@ -1,14 +1,12 @@
 // somebar - dwl barbar
 // See LICENSE file for copyright and license details.
 
+#include <algorithm>
 #include <wayland-client-protocol.h>
-#include <pango/pangocairo.h>
 #include "bar.hpp"
-#include "cairo.h"
 #include "config.hpp"
-#include "pango/pango-font.h"
-#include "pango/pango-fontmap.h"
-#include "pango/pango-layout.h"
+#include "render_worker.hpp"
+#include "scale.hpp"
 
 const zwlr_layer_surface_v1_listener Bar::_layerSurfaceListener = {
 	[](void* owner, zwlr_layer_surface_v1*, uint32_t serial, uint32_t width, uint32_t height)
@@ -16,6 +14,14 @@ const zwlr_layer_surface_v1_listener Bar::_layerSurfaceListener = {
 		static_cast<Bar*>(owner)->layerSurfaceConfigure(serial, width, height);
 	}
 };
+const wp_fractional_scale_v1_listener Bar::_fractionalScaleListener = {
+	[](void* owner, wp_fractional_scale_v1*, uint32_t scale)
+	{
+		auto bar = static_cast<Bar*>(owner);
+		bar->_preferredScale = scale;
+		bar->updateScale();
+	}
+};
 const wl_callback_listener Bar::_frameListener = {
 	[](void* owner, wl_callback* cb, uint32_t)
 	{
@@ -24,75 +30,35 @@ const wl_callback_listener Bar::_frameListener = {
 	}
 };
 
-struct Font {
-	PangoFontDescription* description;
-	int height {0};
-};
-static Font getFont()
-{
-	auto fontMap = pango_cairo_font_map_get_default();
-	if (!fontMap) {
-		die("pango_cairo_font_map_get_default");
-	}
-	auto fontDesc = pango_font_description_from_string(font);
-	if (!fontDesc) {
-		die("pango_font_description_from_string");
-	}
-	auto tempContext = pango_font_map_create_context(fontMap);
-	if (!tempContext) {
-		die("pango_font_map_create_context");
-	}
-	auto font = pango_font_map_load_font(fontMap, tempContext, fontDesc);
-	if (!font) {
-		die("pango_font_map_load_font");
-	}
-	auto metrics = pango_font_get_metrics(font, pango_language_get_default());
-	if (!metrics) {
-		die("pango_font_get_metrics");
-	}
-
-	auto res = Font {};
-	res.description = fontDesc;
-	res.height = PANGO_PIXELS(pango_font_metrics_get_height(metrics));
-
-	pango_font_metrics_unref(metrics);
-	g_object_unref(font);
-	g_object_unref(tempContext);
-	return res;
-}
-static Font barfont = getFont();
-
-BarComponent::BarComponent() { }
-BarComponent::BarComponent(wl_unique_ptr<PangoLayout> layout)
-	: pangoLayout {std::move(layout)}
+static bool useSubsurfaces()
 {
+	return regionSubsurfaces && subcompositor && viewporter;
 }
 
-int BarComponent::width() const
+// with subsurfaces, the buffers of a region only hold its part of the bar.
+// They are made a bit wider than it needs, so a region that grows by a few
+// pixels still fits.
+static int regionBufferWidth(int width, int barWidth)
 {
-	int w, h;
-	pango_layout_get_size(pangoLayout.get(), &w, &h);
-	return PANGO_PIXELS(w);
+	return std::clamp(width + barWidth/8, 1, std::max(barWidth, 1));
 }
 
-void BarComponent::setText(const std::string& text)
+Bar::Bar()
+	: _renderer {std::make_unique<BarRenderer>()}
+	, _tags(tagNames.size(), Tag {TagState::None, 0, 0})
+	, _status {std::make_shared<const std::string>()}
 {
-	_text = std::make_unique<std::string>(text);
-	pango_layout_set_text(pangoLayout.get(), _text->c_str(), _text->size());
+	_positions.tagX.resize(tagNames.size());
+	updateHitAreas();
 }
 
-Bar::Bar()
+Bar::~Bar()
 {
-	_pangoContext.reset(pango_font_map_create_context(pango_cairo_font_map_get_default()));
-	if (!_pangoContext) {
-		die("pango_font_map_create_context");
+	cancelRender();
+	if (renderWorker) {
+		// pango objects are only ever touched by the render thread
+		renderWorker->retire(std::move(_renderer));
 	}
-	for (const auto& tagName : tagNames) {
-		_tags.push_back({ TagState::None, 0, 0, createComponent(tagName) });
-	}
-	_layoutCmp = createComponent();
-	_titleCmp = createComponent();
-	_statusCmp = createComponent();
 }
 
 const wl_surface* Bar::surface() const
@@ -102,25 +68,53 @@ const wl_surface* Bar::surface() const
 
 bool Bar::visible() const
 {
-	return _surface.get();
+	return _shown;
 }
 
+// the surfaces are created on the first show(), and kept until the bar is
+// destroyed. Hiding only unmaps them, so showing the bar again needs no new
+// buffers and no redraw.
 void Bar::show(wl_output* output)
 {
 	if (visible()) {
 		return;
 	}
+	_shown = true;
+	if (_surface) {
+		// unmapping reset the layer surface, so it is set up and configured again
+		setupLayerSurface();
+		wl_surface_commit(_surface.get());
+		return;
+	}
 	_surface.reset(wl_compositor_create_surface(compositor));
 	_layerSurface.reset(zwlr_layer_shell_v1_get_layer_surface(wlrLayerShell,
 		_surface.get(), output, ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM, "net.tapesoftware.Somebar"));
 	zwlr_layer_surface_v1_add_listener(_layerSurface.get(), &_layerSurfaceListener, this);
-	auto anchor = topbar ? ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP : ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM;
-	zwlr_layer_surface_v1_set_anchor(_layerSurface.get(),
-		anchor | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
+	setupLayerSurface();
+	if (viewporter) {
+		_viewport.reset(wp_viewporter_get_viewport(viewporter, _surface.get()));
+		if (fractionalScaleManager) {
+			_fractionalScale.reset(wp_fractional_scale_manager_v1_get_fractional_scale(
+				fractionalScaleManager, _surface.get()));
+			wp_fractional_scale_v1_add_listener(_fractionalScale.get(), &_fractionalScaleListener, this);
+		}
+	}
 
-	auto barSize = barfont.height + paddingY * 2;
-	zwlr_layer_surface_v1_set_size(_layerSurface.get(), 0, barSize);
-	zwlr_layer_surface_v1_set_exclusive_zone(_layerSurface.get(), barSize);
+	if (!useSubsurfaces()) {
+		_regions.emplace_back();
+	} else {
+		// clicks go through to the layer surface, in its coordinates
+		auto noInput = wl_compositor_create_region(compositor);
+		for (auto i = 0; i < RegionCount; i++) {
+			auto& region = _regions.emplace_back();
+			region.surface.reset(wl_compositor_create_surface(compositor));
+			region.subsurface.reset(wl_subcompositor_get_subsurface(subcompositor,
+				region.surface.get(), _surface.get()));
+			region.viewport.reset(wp_viewporter_get_viewport(viewporter, region.surface.get()));
+			wl_surface_set_input_region(region.surface.get(), noInput);
+		}
+		wl_region_destroy(noInput);
+	}
 	wl_surface_commit(_surface.get());
 }
 
@@ -129,39 +123,90 @@ void Bar::hide()
 	if (!visible()) {
 		return;
 	}
-	_layerSurface.reset();
-	_surface.reset();
-	_bufs.reset();
+	cancelRender();
+	_shown = false;
+	_configured = false;
+	// the frame callback may never come for an unmapped surface
+	_invalid = false;
+	// the subsurfaces keep their buffers, they are hidden along with their parent
+	wl_surface_attach(_surface.get(), nullptr, 0, 0);
+	wl_surface_commit(_surface.get());
+}
+
+void Bar::setupLayerSurface()
+{
+	auto anchor = topbar ? ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP : ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM;
+	zwlr_layer_surface_v1_set_anchor(_layerSurface.get(),
+		anchor | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
+
+	auto barSize = barHeight();
+	zwlr_layer_surface_v1_set_size(_layerSurface.get(), 0, barSize);
+	zwlr_layer_surface_v1_set_exclusive_zone(_layerSurface.get(), barSize);
 }
 
 void Bar::setTag(int tag, int state, int numClients, int focusedClient)
 {
 	auto& t = _tags[tag];
+	if (t.state == state && t.numClients == numClients && t.focusedClient == focusedClient) {
+		return;
+	}
 	t.state = state;
 	t.numClients = numClients;
 	t.focusedClient = focusedClient;
+	_dirty = true;
 }
 
 void Bar::setSelected(bool selected)
 {
+	if (_selected == selected) {
+		return;
+	}
 	_selected = selected;
+	_dirty = true;
+}
+void Bar::setLayout(std::string_view layout)
+{
+	if (layout != _layout) {
+		_layout.assign(layout);
+		_dirty = true;
+	}
+}
+void Bar::setTitle(std::string_view title)
+{
+	if (title != _title) {
+		_title.assign(title);
+		_dirty = true;
+	}
 }
-void Bar::setLayout(const std::string& layout)
+void Bar::setStatus(std::shared_ptr<const std::string> status)
 {
-	_layoutCmp.setText(layout);
+	_pendingStatus.reset();
+	if (*status != *_status) {
+		_status = std::move(status);
+		_dirty = true;
+	}
 }
-void Bar::setTitle(const std::string& title)
+bool Bar::queueStatus(std::shared_ptr<const std::string> status)
 {
-	_titleCmp.setText(title);
+	if (!visible()) {
+		// no frame is coming
+		setStatus(std::move(status));
+		return false;
+	}
+	auto replaced = _pendingStatus != nullptr;
+	_pendingStatus = std::move(status);
+	invalidate();
+	return replaced;
 }
-void Bar::setStatus(const std::string& status)
+
+bool Bar::dirty() const
 {
-	_statusCmp.setText(status);
+	return _dirty || _pendingStatus;
 }
 
 void Bar::invalidate()
 {
-	if (_invalid || !visible()) {
+	if (_invalid || !_configured || !dirty()) {
 		return;
 	}
 	_invalid = true;
@@ -170,27 +215,48 @@ void Bar::invalidate()
 	wl_surface_commit(_surface.get());
 }
 
+void Bar::updateHitAreas()
+{
+	_hitAreas.clear();
+	// a component that starts further left is drawn first, so the ones after
+	// it cover it from where they start, like the status covers a long title
+	auto add = [&](int x, int control, int index) {
+		while (!_hitAreas.empty() && _hitAreas.back().x >= x) {
+			_hitAreas.pop_back();
+		}
+		_hitAreas.push_back(HitArea {x, control, index});
+	};
+	for (auto tag = size_t {0}; tag < _positions.tagX.size(); tag++) {
+		add(_positions.tagX[tag], ClkTagBar, tag);
+	}
+	add(_positions.layoutX, ClkLayoutSymbol, 0);
+	add(_positions.titleX, ClkWinTitle, 0);
+	const auto& segments = _positions.statusSegmentX;
+	for (auto segment = size_t {0}; segment < segments.size(); segment++) {
+		add(std::max(segments[segment], _positions.statusX), ClkStatusText, segment);
+	}
+}
+
 void Bar::click(Monitor* mon, int x, int, int btn)
 {
+	// the positions are in buffer pixels
+	x = toBuffer(x, _scale);
+	auto it = std::upper_bound(_hitAreas.begin(), _hitAreas.end(), x,
+		[](int x, const HitArea& area) { return x < area.x; });
+	if (it == _hitAreas.begin()) {
+		return;
+	}
+	const auto& area = *--it;
 	Arg arg = {0};
 	Arg* argp = nullptr;
-	int control = ClkNone;
-	if (x > _statusCmp.x) {
-		control = ClkStatusText;
-	} else if (x > _titleCmp.x) {
-		control = ClkWinTitle;
-	} else if (x > _layoutCmp.x) {
-		control = ClkLayoutSymbol;
-	} else for (auto tag = _tags.size()-1; tag >= 0; tag--) {
-		if (x > _tags[tag].component.x) {
-			control = ClkTagBar;
-			arg.ui = 1<<tag;
-			argp = &arg;
-			break;
-		}
+	if (area.control == ClkTagBar) {
+		arg.ui = 1<<area.index;
+		argp = &arg;
 	}
+	auto segment = area.control == ClkStatusText ? area.index : -1;
 	for (const auto& button : buttons) {
-		if (button.control == control && button.btn == btn) {
+		if (button.control == area.control && button.btn == btn
+			&& (button.segment < 0 || button.segment == segment)) {
 			button.func(*mon, *(argp ? argp : &button.arg));
 			return;
 		}
@@ -200,116 +266,278 @@ void Bar::click(Monitor* mon, int x, int, int btn)
 void Bar::layerSurfaceConfigure(uint32_t serial, uint32_t width, uint32_t height)
 {
 	zwlr_layer_surface_v1_ack_configure(_layerSurface.get(), serial);
-	if (_bufs && width == _bufs->width && height == _bufs->height) {
-		return;
+	if (!_width) {
+		timelineMark("bar configured");
 	}
-	_bufs.emplace(width, height, WL_SHM_FORMAT_XRGB8888);
-	render();
+	auto remap = !_configured;
+	_configured = true;
+	_width = width;
+	_height = height;
+	if (_regions.front().bufs && _bufferWidth == toBuffer(_width, _scale)
+			&& _bufferHeight == toBuffer(_height, _scale)) {
+		if (!remap || reattach()) {
+			return;
+		}
+	}
+	resize();
 }
 
-void Bar::render()
+void Bar::setOutputScale(int scale)
 {
-	if (!_bufs) {
+	_outputScale = scale;
+	updateScale();
+}
+
+// the compositor's preferred scale for the surface wins over the output's,
+// as it may be fractional
+void Bar::updateScale()
+{
+	auto scale = _preferredScale ? static_cast<int>(_preferredScale) : _outputScale * scaleBase;
+	if (scale == _scale) {
 		return;
 	}
-	auto img = wl_unique_ptr<cairo_surface_t> {cairo_image_surface_create_for_data(
-		_bufs->data(),
-		CAIRO_FORMAT_ARGB32,
-		_bufs->width,
-		_bufs->height,
-		_bufs->stride
-		)};
-	auto painter = wl_unique_ptr<cairo_t> {cairo_create(img.get())};
-	_painter = painter.get();
-	pango_cairo_update_context(_painter, _pangoContext.get());
-	_x = 0;
-
-	renderTags();
-	setColorScheme(_selected ? colorActive : colorInactive);
-	renderComponent(_layoutCmp);
-	renderComponent(_titleCmp);
-	renderStatus();
-
-	_painter = nullptr;
-	wl_surface_attach(_surface.get(), _bufs->buffer(), 0, 0);
-	wl_surface_damage(_surface.get(), 0, 0, _bufs->width, _bufs->height);
-	wl_surface_commit(_surface.get());
-	_bufs->flip();
-	_invalid = false;
+	_scale = scale;
+	if (_configured) {
+		resize();
+	}
 }
 
-void Bar::renderTags()
+// sizes the buffers for the surface size at the current scale, and draws the
+// bar from scratch
+void Bar::resize()
 {
-	for (auto &tag : _tags) {
-		setColorScheme(
-			tag.state & TagState::Active ? colorActive : colorInactive,
-			tag.state & TagState::Urgent);
-		renderComponent(tag.component);
-		auto indicators = std::min(tag.numClients, static_cast<int>(_bufs->height/2));
-		for (auto ind = 0; ind < indicators; ind++) {
-			auto w = ind == tag.focusedClient ? 7 : 1;
-			cairo_move_to(_painter, tag.component.x, ind*2+0.5);
-			cairo_rel_line_to(_painter, w, 0);
-			cairo_close_path(_painter);
-			cairo_set_line_width(_painter, 1);
-			cairo_stroke(_painter);
+	// the frame being rendered has the old size
+	cancelRender();
+	_bufferWidth = toBuffer(_width, _scale);
+	_bufferHeight = toBuffer(_height, _scale);
+	for (auto& region : _regions) {
+		if (!region.bufs) {
+			// render() gives up while every buffer is held by the compositor
+			region.bufs.emplace(WL_SHM_FORMAT_XRGB8888, [this]() { render(); });
 		}
+		auto width = _bufferWidth;
+		if (region.subsurface) {
+			// the region is likely as wide as before, renderDone() grows them if not
+			width = regionBufferWidth(region.width > 0
+				? toBuffer(region.width, _scale) : _bufferWidth/RegionCount, _bufferWidth);
+		}
+		region.bufs->resize(width, _bufferHeight);
+		region.committed = nullptr;
+		// the viewport needs the new size
+		region.width = -1;
+	}
+	if (_viewport) {
+		// works for fractional scales, too. The compositor samples the buffer 1:1.
+		wp_viewport_set_destination(_viewport.get(), _width, _height);
+	} else {
+		wl_surface_set_buffer_scale(_surface.get(), _scale / scaleBase);
 	}
+	if (_regions.front().subsurface) {
+		showBackground();
+	}
+	_resized = true;
+	render();
 }
 
-void Bar::renderStatus()
+// shows what the bar showed before it was hidden. Returns false if there is
+// nothing to show again, then the bar has to be drawn from scratch.
+bool Bar::reattach()
 {
-	pango_cairo_update_layout(_painter, _statusCmp.pangoLayout.get());
-	beginBg();
-	auto start = _bufs->width - _statusCmp.width() - paddingX*2;
-	cairo_rectangle(_painter, _x, 0, _bufs->width-_x+start, _bufs->height);
-	cairo_fill(_painter);
-
-	_x = start;
-	renderComponent(_statusCmp);
+	if (_regions.front().subsurface) {
+		showBackground();
+	} else {
+		auto& region = _regions.front();
+		if (!region.committed || !region.bufs->reacquire(region.committed)) {
+			return false;
+		}
+		wl_surface_attach(_surface.get(), region.committed->buffer.get(), 0, 0);
+		wl_surface_damage_buffer(_surface.get(), 0, 0, region.committed->width, region.committed->height);
+	}
+	wl_surface_commit(_surface.get());
+	// draw whatever changed while the bar was hidden
+	invalidate();
+	return true;
 }
 
-void Bar::setColorScheme(const ColorScheme& scheme, bool invert)
+// attaches a single pixel in the background color to the layer surface, which
+// its viewport stretches over the whole bar. It shows up with the next commit.
+void Bar::showBackground()
 {
-	_colorScheme = invert
-		? ColorScheme {scheme.bg, scheme.fg}
-		: ColorScheme {scheme.fg, scheme.bg};
+	if (_background) {
+		_background->reacquire(_backgroundPixel);
+		wl_surface_attach(_surface.get(), _backgroundPixel->buffer.get(), 0, 0);
+	} else {
+		_background.emplace(WL_SHM_FORMAT_XRGB8888, []() { });
+		_background->resize(1, 1);
+		auto pixel = _background->acquire();
+		if (!pixel) {
+			die("shm buffer");
+		}
+		auto painter = pixel->painter.get();
+		const auto& bg = colorInactive.bg;
+		cairo_save(painter);
+		cairo_set_source_rgb(painter, bg.r/255.0, bg.g/255.0, bg.b/255.0);
+		cairo_set_operator(painter, CAIRO_OPERATOR_SOURCE);
+		cairo_paint(painter);
+		cairo_restore(painter);
+		cairo_surface_flush(pixel->surface.get());
+		// stays attached until the bar is hidden, and is attached again on show
+		wl_surface_attach(_surface.get(), pixel->buffer.get(), 0, 0);
+		_backgroundPixel = pixel;
+	}
+	wl_surface_damage_buffer(_surface.get(), 0, 0, 1, 1);
 }
-static void setColor(cairo_t* painter, const Color& color)
+
+// takes a snapshot of the bar, and renders it into free buffers, either
+// right here or on the render thread. renderDone() finishes the frame.
+void Bar::render()
 {
-	cairo_set_source_rgba(painter,
-		color.r/255.0, color.g/255.0, color.b/255.0, color.a/255.0);
+	if (!_configured || _rendering) {
+		return;
+	}
+	auto buffers = std::vector<ShmBuffer::Buffer*> {};
+	for (auto& region : _regions) {
+		region.renderBuffer = region.bufs->acquire();
+		if (!region.renderBuffer) {
+			// the compositor holds every buffer of this region. _invalid stays set,
+			// so no frame is requested, and the pool calls render() again once a
+			// buffer is released.
+			cancelRenderBuffers();
+			return;
+		}
+		buffers.push_back(region.renderBuffer);
+	}
+	if (_pendingStatus) {
+		if (*_pendingStatus != *_status) {
+			_status = std::move(_pendingStatus);
+		}
+		_pendingStatus.reset();
+	}
+	auto snapshot = BarSnapshot {++_generation, _tags, _layout, _title, _status, _selected,
+		_scale, _bufferWidth, _bufferHeight, _resized};
+	_resized = false;
+	_dirty = false;
+	_rendering = true;
+	if (renderWorker) {
+		renderWorker->post(this, _renderer.get(), std::move(snapshot), std::move(buffers));
+	} else {
+		renderDone(_renderer->render(snapshot, buffers));
+	}
 }
-void Bar::beginFg()
+
+void Bar::renderDone(RenderResult result)
 {
-	setColor(_painter, _colorScheme.fg);
+	_rendering = false;
+	if (result.positions != _positions) {
+		_positions = std::move(result.positions);
+		updateHitAreas();
+	}
+	// a newer frame may already be on screen
+	auto stale = result.generation <= _committedGeneration;
+	auto committed = false;
+	auto grown = false;
+	auto rendered = result.buffers.begin();
+	for (auto& region : _regions) {
+		region.renderBuffer = nullptr;
+		const auto& r = *rendered++;
+		if (r.needWidth) {
+			// the region outgrew its buffers. It keeps showing what it showed,
+			// and is drawn into wider ones right after this frame.
+			region.bufs->cancel(r.buffer);
+			region.bufs->resize(regionBufferWidth(r.needWidth, _bufferWidth), _bufferHeight);
+			grown = true;
+			continue;
+		}
+		auto moved = region.subsurface && (r.x != region.x || r.width != region.width);
+		if (stale || (r.damage.empty() && !moved)) {
+			region.bufs->cancel(r.buffer);
+			continue;
+		}
+		commitRegion(region, r);
+		committed = true;
+	}
+	if (committed) {
+		if (_regions.front().subsurface) {
+			// subsurface commits only take effect with their parent's
+			wl_surface_commit(_surface.get());
+		}
+		if (!_committedGeneration) {
+			timelineMark("first frame of a bar committed");
+		}
+		_committedGeneration = result.generation;
+	}
+	_invalid = false;
+	if (grown) {
+		// the new buffers hold nothing yet, so the next frame draws everything
+		_resized = true;
+		render();
+		return;
+	}
+	// pick up whatever changed while the frame was rendered
+	invalidate();
 }
-void Bar::beginBg()
+
+void Bar::commitRegion(Region& region, const RenderedBuffer& rendered)
 {
-	setColor(_painter, _colorScheme.bg);
+	auto surface = region.surface ? region.surface.get() : _surface.get();
+	if (region.subsurface && (rendered.x != region.x || rendered.width != region.width)) {
+		region.x = rendered.x;
+		region.width = rendered.width;
+		wl_subsurface_set_position(region.subsurface.get(), rendered.x, 0);
+		if (rendered.width <= 0) {
+			// e.g. there is no status. A viewport cannot be empty, so unmap instead.
+			region.bufs->cancel(rendered.buffer);
+			region.committed = nullptr;
+			wl_surface_attach(surface, nullptr, 0, 0);
+			wl_surface_commit(surface);
+			return;
+		}
+		// the buffer starts with the region, and is larger with a scale
+		auto from = toBuffer(rendered.x, _scale);
+		auto to = toBuffer(rendered.x + rendered.width, _scale);
+		wp_viewport_set_source(region.viewport.get(), 0, 0,
+			wl_fixed_from_int(to - from), wl_fixed_from_int(region.bufs->height()));
+		wp_viewport_set_destination(region.viewport.get(), rendered.width, _height);
+	}
+	if (rendered.damage.empty()) {
+		// moved along with a neighbour, but shows the same pixels
+		region.bufs->cancel(rendered.buffer);
+	} else {
+		wl_surface_attach(surface, rendered.buffer->buffer.get(), 0, 0);
+		region.committed = rendered.buffer;
+		for (const auto& span : rendered.damage.spans()) {
+			wl_surface_damage_buffer(surface, span.x, 0, span.width, rendered.buffer->height);
+		}
+	}
+	wl_surface_commit(surface);
 }
 
-void Bar::renderComponent(BarComponent& component)
+// drops the frame that is being rendered, if any. Waits for the render thread
+// if it is drawing right now, as the buffers are about to go away.
+void Bar::cancelRender()
 {
-	pango_cairo_update_layout(_painter, component.pangoLayout.get());
-	auto size = component.width() + paddingX*2;
-	component.x = _x;
-
-	beginBg();
-	cairo_rectangle(_painter, _x, 0, size, _bufs->height);
-	cairo_fill(_painter);
-	cairo_move_to(_painter, _x+paddingX, paddingY);
-
-	beginFg();
-	pango_cairo_show_layout(_painter, component.pangoLayout.get());
-	_x += size;
+	if (!_rendering) {
+		return;
+	}
+	if (renderWorker) {
+		renderWorker->cancel(this);
+	}
+	cancelRenderBuffers();
+	_rendering = false;
+	_invalid = false;
+	// the dropped snapshot may have been the only one with these changes
+	_dirty = true;
+	// the render thread may have drawn it already, and the renderer counts it
+	// as shown. Its damage never reached the compositor, so draw everything.
+	_resized = true;
 }
 
-BarComponent Bar::createComponent(const std::string &initial)
+void Bar::cancelRenderBuffers()
 {
-	auto layout = pango_layout_new(_pangoContext.get());
-	pango_layout_set_font_description(layout, barfont.description);
-	auto res = BarComponent {wl_unique_ptr<PangoLayout> {layout}};
-	res.setText(initial);
-	return res;
+	for (auto& region : _regions) {
+		if (region.renderBuffer) {
+			region.bufs->cancel(region.renderBuffer);
+			region.renderBuffer = nullptr;
+		}
+	}
 }
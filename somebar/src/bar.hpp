@@ -2,73 +2,122 @@
 // See LICENSE file for copyright and license details.
 
 #pragma once
+#include <list>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <wayland-client.h>
+#include "fractional-scale-v1-client-protocol.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 #include "common.hpp"
+#include "bar_renderer.hpp"
+#include "scale.hpp"
 #include "shm_buffer.hpp"
 
-class BarComponent {
-	std::unique_ptr<std::string> _text;
-public:
-	BarComponent();
-	explicit BarComponent(wl_unique_ptr<PangoLayout> layout);
-	int width() const;
-	void setText(const std::string& text);
-	wl_unique_ptr<PangoLayout> pangoLayout;
-	int x {0};
-};
-
-struct Tag {
-	int state;
-	int numClients;
-	int focusedClient;
-	BarComponent component;
-};
-
 struct Monitor;
+// the bar's surface and state. Drawing is left to a BarRenderer, which runs
+// on the render thread if there is one.
 class Bar {
 	static const zwlr_layer_surface_v1_listener _layerSurfaceListener;
 	static const wl_callback_listener _frameListener;
+	static const wp_fractional_scale_v1_listener _fractionalScaleListener;
+
+	// a part of the bar with buffers of its own. With subsurfaces, there is
+	// one per BarRegion. Otherwise there is only one, the layer surface itself.
+	struct Region {
+		// null if this is the layer surface
+		wl_unique_ptr<wl_surface> surface;
+		wl_unique_ptr<wl_subsurface> subsurface;
+		wl_unique_ptr<wp_viewport> viewport;
+		std::optional<ShmBuffer> bufs;
+		ShmBuffer::Buffer* renderBuffer {nullptr};
+		// attached in the last commit, shown again after the bar was hidden
+		ShmBuffer::Buffer* committed {nullptr};
+		// the part of the bar the surface shows since the last commit
+		int x {-1}, width {-1};
+	};
 
 	wl_unique_ptr<wl_surface> _surface;
 	wl_unique_ptr<zwlr_layer_surface_v1> _layerSurface;
-	wl_unique_ptr<PangoContext> _pangoContext;
-	std::optional<ShmBuffer> _bufs;
+	std::list<Region> _regions;
+	// scales the buffers to the surface size. With subsurfaces, the layer
+	// surface only shows a single pixel, stretched by this.
+	wl_unique_ptr<wp_viewport> _viewport;
+	wl_unique_ptr<wp_fractional_scale_v1> _fractionalScale;
+	std::optional<ShmBuffer> _background;
+	ShmBuffer::Buffer* _backgroundPixel {nullptr};
+	std::unique_ptr<BarRenderer> _renderer;
 	std::vector<Tag> _tags;
-	BarComponent _layoutCmp, _titleCmp, _statusCmp;
-	bool _selected;
+	std::string _layout, _title;
+	std::shared_ptr<const std::string> _status;
+	std::shared_ptr<const std::string> _pendingStatus;
+	bool _selected {false};
+	bool _resized {false};
+	bool _shown {false};
+	// the surface size from the last configure
+	int _width {0}, _height {0};
+	// the size of the whole bar in buffer pixels, as of the last resize()
+	int _bufferWidth {0}, _bufferHeight {0};
+	// in 120ths, see scale.hpp. The preferred scale is 0 until the compositor sends one.
+	int _scale {scaleBase};
+	int _outputScale {1};
+	uint32_t _preferredScale {0};
+	// the layer surface was configured since it was last shown, so buffers may be attached
+	bool _configured {false};
+	// something changed since the last snapshot
+	bool _dirty {true};
 	bool _invalid {false};
+	// a snapshot is being rendered into the regions' renderBuffer
+	bool _rendering {false};
+	uint64_t _generation {0};
+	uint64_t _committedGeneration {0};
+	ComponentPositions _positions;
+	// what a click lands on, sorted by where it starts. Each area ends where the
+	// next one starts. Rebuilt from _positions when the layout moves.
+	struct HitArea {
+		int x;
+		int control;
+		// the tag, or the status segment
+		int index;
+	};
+	std::vector<HitArea> _hitAreas;
 
-	// only vaild during render()
-	cairo_t* _painter {nullptr};
-	int _x;
-	ColorScheme _colorScheme;
-
+	void setupLayerSurface();
 	void layerSurfaceConfigure(uint32_t serial, uint32_t width, uint32_t height);
+	bool reattach();
+	void updateScale();
+	void resize();
 	void render();
-	void renderTags();
-	void renderStatus();
-
-	// low-level rendering
-	void setColorScheme(const ColorScheme& scheme, bool invert = false);
-	void beginFg();
-	void beginBg();
-	void renderComponent(BarComponent& component);
-	BarComponent createComponent(const std::string& initial = {});
+	void cancelRender();
+	void cancelRenderBuffers();
+	void commitRegion(Region& region, const RenderedBuffer& rendered);
+	void showBackground();
+	void updateHitAreas();
+	bool dirty() const;
 public:
 	Bar();
+	Bar(const Bar&) = delete;
+	Bar& operator=(const Bar&) = delete;
+	~Bar();
 	const wl_surface* surface() const;
 	bool visible() const;
 	void show(wl_output* output);
 	void hide();
 	void setTag(int tag, int state, int numClients, int focusedClient);
 	void setSelected(bool selected);
-	void setLayout(const std::string& layout);
-	void setTitle(const std::string& title);
-	void setStatus(const std::string& status);
+	void setLayout(std::string_view layout);
+	void setTitle(std::string_view title);
+	void setStatus(std::shared_ptr<const std::string> status);
+	// the integer scale of the output, as sent by wl_output
+	void setOutputScale(int scale);
+	int scale() const { return _scale; }
+	// latest value wins: the status is only laid out when the next frame is
+	// rendered. returns true if this replaced a status that was never shown.
+	bool queueStatus(std::shared_ptr<const std::string> status);
 	void invalidate();
+	// called with the result of render(), on the main thread
+	void renderDone(RenderResult result);
 	void click(Monitor* mon, int x, int y, int btn);
 };
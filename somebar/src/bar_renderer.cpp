@@ -0,0 +1,462 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <algorithm>
+#include <future>
+#include <unordered_map>
+#include <pango/pangocairo.h>
+#include "bar_renderer.hpp"
+#include "config.hpp"
+#include "raster_cache.hpp"
+#include "scale.hpp"
+
+// frames of damage kept for buffers that are behind. The pool never has more
+// buffers than this, so a buffer that is further behind is redrawn completely.
+constexpr size_t maxHistory = 4;
+
+struct Font {
+	PangoFontDescription* description;
+	int height {0};
+};
+static Font getFont()
+{
+	auto fontMap = pango_cairo_font_map_get_default();
+	if (!fontMap) {
+		die("pango_cairo_font_map_get_default");
+	}
+	auto fontDesc = pango_font_description_from_string(font);
+	if (!fontDesc) {
+		die("pango_font_description_from_string");
+	}
+	auto tempContext = pango_font_map_create_context(fontMap);
+	if (!tempContext) {
+		die("pango_font_map_create_context");
+	}
+	auto font = pango_font_map_load_font(fontMap, tempContext, fontDesc);
+	if (!font) {
+		die("pango_font_map_load_font");
+	}
+	auto metrics = pango_font_get_metrics(font, pango_language_get_default());
+	if (!metrics) {
+		die("pango_font_get_metrics");
+	}
+
+	auto res = Font {};
+	res.description = fontDesc;
+	res.height = PANGO_PIXELS(pango_font_metrics_get_height(metrics));
+
+	pango_font_metrics_unref(metrics);
+	g_object_unref(font);
+	g_object_unref(tempContext);
+	return res;
+}
+static std::future<Font> fontLoader;
+// the tags the font loader shaped, kept so they are still there for the first frame
+static std::vector<std::shared_ptr<const SharedLayout>> preshapedTags;
+
+// layouts shaped with font at scale, in buffer pixels. Only used by the font
+// loader, and then by whichever thread renders. Never destroyed: components in
+// other translation units may outlive any static.
+static LayoutStore& layouts(const Font& font, int scale)
+{
+	static auto stores = new std::unordered_map<int, LayoutStore*> {};
+	auto& store = (*stores)[scale];
+	if (!store) {
+		auto desc = pango_font_description_copy(font.description);
+		auto size = pango_font_description_get_size(desc) * scale / scaleBase;
+		if (pango_font_description_get_size_is_absolute(desc)) {
+			pango_font_description_set_absolute_size(desc, size);
+		} else {
+			pango_font_description_set_size(desc, size);
+		}
+		store = new LayoutStore {desc, fastText};
+	}
+	return *store;
+}
+
+void loadFont()
+{
+	fontLoader = std::async(std::launch::async, []() {
+		auto font = getFont();
+		timelineMark("font loaded");
+		// every bar shows the tags, so shape them before the first configure
+		auto& store = layouts(font, scaleBase);
+		for (const auto& name : tagNames) {
+			preshapedTags.push_back(store.get(name));
+		}
+		timelineMark("tags shaped");
+		return font;
+	});
+}
+
+static const Font& barfont()
+{
+	static const auto font = fontLoader.valid() ? fontLoader.get() : getFont();
+	return font;
+}
+
+int barHeight()
+{
+	return barfont().height + paddingY * 2;
+}
+
+static LayoutStore& layouts(int scale)
+{
+	return layouts(barfont(), scale);
+}
+
+int BarComponent::width() const
+{
+	return _layout->width();
+}
+
+bool BarComponent::setText(std::string_view text, LayoutStore& store, int maxWidth)
+{
+	// pango drops its shaped lines on every set_text, so avoid it if we can
+	if (_layout && text == _layout->text && _store == &store) {
+		if (maxWidth == _layout->maxWidth) {
+			return false;
+		}
+		// text that is not ellipsized stays as it is while it fits
+		if (_layout->maxWidth < 0 && maxWidth >= 0 && _layout->width() <= maxWidth) {
+			return false;
+		}
+	}
+	// bars that show the same text share one layout, so it is shaped only once
+	auto layout = store.get(text, maxWidth);
+	if (layout == _layout) {
+		return false;
+	}
+	_layout = std::move(layout);
+	_store = &store;
+	_dirty = true;
+	return true;
+}
+
+static const ColorScheme& tagColorScheme(int state)
+{
+	static const ColorScheme urgentInactive {colorInactive.bg, colorInactive.fg};
+	static const ColorScheme urgentActive {colorActive.bg, colorActive.fg};
+	if (state & TagState::Urgent) {
+		return state & TagState::Active ? urgentActive : urgentInactive;
+	}
+	return state & TagState::Active ? colorActive : colorInactive;
+}
+
+RenderResult BarRenderer::render(const BarSnapshot& snapshot, const std::vector<ShmBuffer::Buffer*>& buffers)
+{
+	_width = snapshot.width;
+	_height = snapshot.height;
+	apply(snapshot);
+	layout();
+	if (snapshot.resized) {
+		// the compositor has none of the surface's contents at the new size
+		_damage.add(0, _width);
+	}
+
+	_spans.resize(buffers.size(), Damage::Span {0, 0});
+	for (auto i = size_t {0}; i < buffers.size(); i++) {
+		auto pixels = this->pixels(region(i, buffers.size()));
+		auto& span = _spans[i];
+		if (span.x != pixels.x || span.width != pixels.width) {
+			// the buffer starts where the region does, so all of it moved
+			_damage.add(pixels.x, pixels.width);
+			span = pixels;
+		}
+	}
+
+	auto result = RenderResult {snapshot.generation, {}, {}};
+	for (auto i = size_t {0}; i < buffers.size(); i++) {
+		auto region = this->region(i, buffers.size());
+		auto pixels = this->pixels(region);
+		auto& rendered = result.buffers.emplace_back(RenderedBuffer {buffers[i], region.x, region.width, _damage});
+		if (static_cast<int>(buffers[i]->width) < pixels.width) {
+			rendered.damage.clear();
+			rendered.needWidth = pixels.width;
+			continue;
+		}
+		rendered.damage.clip(pixels.x, pixels.width);
+		if (rendered.damage.empty()) {
+			continue;
+		}
+		rendered.damage.translate(-pixels.x);
+		_buffer = buffers[i];
+		_painter = _buffer->painter.get();
+		collectBufferDamage(pixels);
+		cairo_save(_painter);
+		cairo_translate(_painter, -pixels.x, 0);
+		renderTags();
+		_colorScheme = _selected ? colorActive : colorInactive;
+		renderComponent(_layoutCmp);
+		renderComponent(_titleCmp);
+		for (auto& part : _statusParts) {
+			renderComponent(part);
+		}
+		cairo_restore(_painter);
+		cairo_surface_flush(_buffer->surface.get());
+		_buffer->frame = _frame + 1;
+		_buffer->origin = pixels.x;
+	}
+	if (!_damage.empty()) {
+		_frame++;
+		_history.push_back(std::move(_damage));
+		if (_history.size() > maxHistory) {
+			_history.pop_front();
+		}
+	}
+	clearDirty();
+
+	_damage.clear();
+	for (const auto& tag : _tags) {
+		result.positions.tagX.push_back(tag.x);
+	}
+	result.positions.layoutX = _layoutCmp.x;
+	result.positions.titleX = _titleCmp.x;
+	result.positions.statusX = _statusParts.front().x;
+	for (auto i = size_t {0}; i < _statusParts.size(); i += 2) {
+		result.positions.statusSegmentX.push_back(_statusParts[i].x);
+	}
+	_buffer = nullptr;
+	_painter = nullptr;
+	return result;
+}
+
+// marks everything that differs from the previous snapshot dirty
+void BarRenderer::apply(const BarSnapshot& snapshot)
+{
+	if (_tags.empty() || snapshot.scale != _scale) {
+		// every layout has to be shaped again with a font of the new size
+		_scale = snapshot.scale;
+		_padX = toBuffer(paddingX, _scale);
+		_layouts = &layouts(_scale);
+		_tags.resize(tagNames.size());
+		_tagState.resize(tagNames.size(), Tag {TagState::None, 0, 0});
+		for (auto i = size_t {0}; i < tagNames.size(); i++) {
+			_tags[i].setText(tagNames[i], *_layouts);
+			// tags switch between these all the time, so render them up front
+			for (auto state : {TagState::None, TagState::Active, TagState::Urgent}) {
+				rasterCache.get(_tags[i].layout(), tagColorScheme(state), _scale, _height);
+			}
+		}
+	}
+	for (auto i = size_t {0}; i < _tags.size() && i < snapshot.tags.size(); i++) {
+		auto& old = _tagState[i];
+		const auto& tag = snapshot.tags[i];
+		if (old.state != tag.state || old.numClients != tag.numClients || old.focusedClient != tag.focusedClient) {
+			old = tag;
+			_tags[i].markDirty();
+		}
+	}
+	_layoutCmp.setText(snapshot.layout, *_layouts);
+	if (snapshot.title != _title) {
+		_title = snapshot.title;
+	}
+	setStatus(*snapshot.status);
+	if (snapshot.selected != _selected) {
+		_selected = snapshot.selected;
+		// the color scheme of everything right of the tags depends on it
+		_layoutCmp.markDirty();
+		_titleCmp.markDirty();
+		for (auto& part : _statusParts) {
+			part.markDirty();
+		}
+	}
+}
+
+// splits status at statusDelimiter. Parts that kept their text are not re-shaped.
+void BarRenderer::setStatus(std::string_view status)
+{
+	auto delimiter = std::string_view {statusDelimiter};
+	auto count = size_t {0};
+	auto setPart = [&](std::string_view text) {
+		if (count == _statusParts.size()) {
+			_statusParts.emplace_back();
+		}
+		_statusParts[count++].setText(text, *_layouts);
+	};
+	for (auto pos = size_t {0}; !delimiter.empty() && (pos = status.find(delimiter)) != status.npos; ) {
+		setPart(status.substr(0, pos));
+		setPart(delimiter);
+		status.remove_prefix(pos + delimiter.size());
+	}
+	setPart(status);
+	for (auto i = count; i < _statusParts.size(); i++) {
+		_damage.add(_statusParts[i].x, _statusParts[i].boxWidth);
+	}
+	_statusParts.erase(_statusParts.begin() + count, _statusParts.end());
+}
+
+// places all components from left to right, and collects the damage of
+// every component that changed or moved
+void BarRenderer::layout()
+{
+	_x = 0;
+	for (auto& tag : _tags) {
+		placeComponent(tag, tag.width() + _padX*2);
+	}
+	placeComponent(_layoutCmp, _layoutCmp.width() + _padX*2);
+	// the title takes up the space between the layout symbol and the status.
+	// It is ellipsized to fit, so a long title is not shaped only to be cut off.
+	auto width = _width;
+	auto statusWidth = _padX*2;
+	for (const auto& part : _statusParts) {
+		statusWidth += part.width();
+	}
+	auto statusX = std::max(width - statusWidth, _x);
+	_titleCmp.setText(_title, *_layouts, std::max(statusX - _x - _padX*2, 0));
+	placeComponent(_titleCmp, statusX - _x);
+	placeStatus();
+}
+
+// the parts of the status sit next to each other without padding, as if they
+// were one text. The first one keeps the left padding, and the last one
+// reaches to the end of the bar.
+void BarRenderer::placeStatus()
+{
+	for (auto i = size_t {0}; i < _statusParts.size(); i++) {
+		auto& part = _statusParts[i];
+		part.inset = i == 0 ? 0 : _padX;
+		auto width = part.width() + _padX - part.inset;
+		if (i == _statusParts.size() - 1) {
+			width = std::max(_width - _x, 0);
+		}
+		placeComponent(part, width);
+	}
+}
+
+void BarRenderer::placeComponent(BarComponent& component, int width)
+{
+	if (component.dirty() || component.x != _x || component.boxWidth != width) {
+		_damage.add(component.x, component.boxWidth);
+		_damage.add(_x, width);
+	}
+	component.x = _x;
+	component.boxWidth = width;
+	_x += width;
+}
+
+// the part of the bar the index-th of count buffers shows, in surface
+// coordinates. With a fractional scale, components need not start on a whole
+// surface coordinate, so regions are rounded outwards and may overlap by one.
+Damage::Span BarRenderer::region(size_t index, size_t count) const
+{
+	auto pixels = Damage::Span {0, _width};
+	if (count > 1) {
+		switch (index) {
+		case RegionTags:
+			pixels = {0, _titleCmp.x};
+			break;
+		case RegionTitle:
+			pixels = {_titleCmp.x, _titleCmp.boxWidth};
+			break;
+		default:
+			pixels = {_statusParts.front().x, _width - _statusParts.front().x};
+		}
+	}
+	auto from = pixels.x * scaleBase / _scale;
+	auto to = ((pixels.x + pixels.width) * scaleBase + _scale - 1) / _scale;
+	while (to > from && toBuffer(to, _scale) > _width) {
+		to--;
+	}
+	return {from, to - from};
+}
+
+// the part of the bar a region in surface coordinates covers, in buffer pixels
+Damage::Span BarRenderer::pixels(const Damage::Span& region) const
+{
+	auto from = toBuffer(region.x, _scale);
+	return {from, toBuffer(region.x + region.width, _scale) - from};
+}
+
+// the buffer may hold an older frame, then it also misses the changes since.
+// buffer.frame tells how far behind it is, and a buffer that held another part
+// of the bar is drawn from scratch. Only the part the buffer shows, given in
+// buffer pixels, is drawn.
+void BarRenderer::collectBufferDamage(const Damage::Span& region)
+{
+	_bufferDamage = _damage;
+	auto behind = _frame - _buffer->frame;
+	if (!_buffer->frame || behind > _history.size() || _buffer->origin != region.x) {
+		_bufferDamage.add(0, _width);
+	} else {
+		for (auto i = _history.size() - behind; i < _history.size(); i++) {
+			_bufferDamage.add(_history[i]);
+		}
+	}
+	_bufferDamage.clip(region.x, region.width);
+}
+
+void BarRenderer::clearDirty()
+{
+	for (auto& tag : _tags) {
+		tag.clearDirty();
+	}
+	_layoutCmp.clearDirty();
+	_titleCmp.clearDirty();
+	for (auto& part : _statusParts) {
+		part.clearDirty();
+	}
+}
+
+void BarRenderer::renderTags()
+{
+	for (auto i = size_t {0}; i < _tags.size(); i++) {
+		auto& component = _tags[i];
+		const auto& tag = _tagState[i];
+		_colorScheme = tagColorScheme(tag.state);
+		renderComponent(component);
+		if (!_bufferDamage.intersects(component.x, component.boxWidth)) {
+			continue;
+		}
+		beginFg();
+		// one surface pixel high, and on whole buffer pixels so they stay sharp
+		auto unit = std::max(toBuffer(1, _scale), 1);
+		auto indicators = std::min(tag.numClients, _height/(unit*2));
+		for (auto ind = 0; ind < indicators; ind++) {
+			auto w = ind == tag.focusedClient ? 7 : 1;
+			cairo_rectangle(_painter, component.x, ind*2*unit, w*unit, unit);
+			cairo_fill(_painter);
+		}
+	}
+}
+
+static void setColor(cairo_t* painter, const Color& color)
+{
+	cairo_set_source_rgba(painter,
+		color.r/255.0, color.g/255.0, color.b/255.0, color.a/255.0);
+}
+void BarRenderer::beginFg()
+{
+	setColor(_painter, _colorScheme.fg);
+}
+void BarRenderer::beginBg()
+{
+	setColor(_painter, _colorScheme.bg);
+}
+
+// draws the component at the place layout() gave it, if that part of the buffer is out of date
+void BarRenderer::renderComponent(BarComponent& component)
+{
+	if (!_bufferDamage.intersects(component.x, component.boxWidth)) {
+		return;
+	}
+	auto height = _height;
+	auto raster = rasterCache.get(component.layout(), _colorScheme, _scale, height);
+	// where the raster ends on the bar
+	auto rasterEnd = component.x - component.inset + cairo_image_surface_get_width(raster);
+	auto boxEnd = component.x + component.boxWidth;
+	cairo_save(_painter);
+	// text that does not fit must not spill into a neighbour that is not redrawn
+	cairo_rectangle(_painter, component.x, 0, component.boxWidth, height);
+	cairo_clip(_painter);
+
+	cairo_set_operator(_painter, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(_painter, raster, component.x - component.inset, 0);
+	cairo_paint(_painter);
+	if (rasterEnd < boxEnd) {
+		beginBg();
+		cairo_rectangle(_painter, rasterEnd, 0, boxEnd - rasterEnd, height);
+		cairo_fill(_painter);
+	}
+	cairo_restore(_painter);
+}
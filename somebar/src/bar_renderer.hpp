@@ -0,0 +1,155 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "common.hpp"
+#include "damage.hpp"
+#include "layout_store.hpp"
+#include "shm_buffer.hpp"
+
+// starts loading the bar font on a thread of its own, which also shapes the
+// tags. barHeight() and the renderers wait for it.
+void loadFont();
+// height of the bar, from the font and padding in config.hpp
+int barHeight();
+
+class BarComponent {
+	// shared with every other component that shows the same text
+	std::shared_ptr<const SharedLayout> _layout;
+	LayoutStore* _store {nullptr};
+	bool _dirty {true};
+public:
+	int width() const;
+	// returns false (and leaves the layout alone) if the text did not change.
+	// A maxWidth ellipsizes the text, see LayoutStore::get().
+	bool setText(std::string_view text, LayoutStore& store, int maxWidth = -1);
+	const std::string& text() const { return _layout->text; }
+	const SharedLayout& layout() const { return *_layout; }
+	bool dirty() const { return _dirty; }
+	void markDirty() { _dirty = true; }
+	void clearDirty() { _dirty = false; }
+	// where the component was placed in the last frame, including padding
+	int x {0};
+	int boxWidth {0};
+	// how much of the left padding is cut off, for text that continues a neighbour
+	int inset {0};
+};
+
+struct Tag {
+	int state;
+	int numClients;
+	int focusedClient;
+};
+
+// everything a frame is drawn from. It is copied out of the Bar, so it can be
+// rendered on another thread while the Bar changes.
+struct BarSnapshot {
+	uint64_t generation;
+	std::vector<Tag> tags;
+	std::string layout, title;
+	std::shared_ptr<const std::string> status;
+	bool selected;
+	// of the output, in 120ths. The buffers are this much larger than the surface.
+	int scale;
+	// of the whole bar, in buffer pixels
+	int width, height;
+	// the surface was resized, so all of it is damaged
+	bool resized;
+};
+
+// where the components ended up, for mapping clicks to them. In buffer pixels.
+struct ComponentPositions {
+	std::vector<int> tagX;
+	int layoutX {0}, titleX {0}, statusX {0};
+	// where each status segment starts. A delimiter belongs to the segment before it.
+	std::vector<int> statusSegmentX;
+
+	bool operator==(const ComponentPositions& other) const
+	{
+		return tagX == other.tagX && layoutX == other.layoutX && titleX == other.titleX
+			&& statusX == other.statusX && statusSegmentX == other.statusSegmentX;
+	}
+	bool operator!=(const ComponentPositions& other) const { return !(*this == other); }
+};
+
+// the parts of the bar that can be shown by surfaces of their own. The tag
+// strip includes the layout symbol.
+enum BarRegion { RegionTags, RegionTitle, RegionStatus, RegionCount };
+
+// a buffer holds the part of the bar from x to x+width, in surface
+// coordinates. Its first column is the first buffer pixel of that part, and it
+// may be wider than the part.
+struct RenderedBuffer {
+	ShmBuffer::Buffer* buffer;
+	int x, width;
+	// the parts of the buffer that changed, in buffer pixels. If empty, buffer
+	// was not drawn to.
+	Damage damage;
+	// if not 0, the buffer is narrower than its part of the bar, which is this
+	// many buffer pixels wide, and was not drawn to
+	int needWidth {0};
+};
+
+struct RenderResult {
+	uint64_t generation;
+	// in the order they were passed to render()
+	std::vector<RenderedBuffer> buffers;
+	ComponentPositions positions;
+};
+
+// turns snapshots into pixels. This is the only part of a bar that uses pango,
+// so it can run on a render thread.
+class BarRenderer {
+	std::vector<Tag> _tagState;
+	std::vector<BarComponent> _tags;
+	BarComponent _layoutCmp, _titleCmp;
+	// the title is only set on _titleCmp by layout(), which knows how much space it gets
+	std::string _title;
+	// the status, split at statusDelimiter: segment, delimiter, segment, ...
+	// Each part has its own layout, so one block changing does not re-shape the others.
+	std::vector<BarComponent> _statusParts;
+	bool _selected {false};
+	int _scale {0};
+	// in buffer pixels, like everything the renderer lays out
+	int _padX {0};
+	int _width {0}, _height {0};
+	LayoutStore* _layouts {nullptr};
+	// damage of the most recent frames, for bringing older buffers up to date
+	std::deque<Damage> _history;
+	uint64_t _frame {0};
+	// the part of the bar each buffer showed in the last frame, in buffer pixels
+	std::vector<Damage::Span> _spans;
+
+	// only valid during render()
+	Damage _damage;
+	Damage _bufferDamage;
+	ShmBuffer::Buffer* _buffer {nullptr};
+	cairo_t* _painter {nullptr};
+	int _x {0};
+	ColorScheme _colorScheme;
+
+	void apply(const BarSnapshot& snapshot);
+	void setStatus(std::string_view status);
+	void layout();
+	void placeStatus();
+	void placeComponent(BarComponent& component, int width);
+	Damage::Span region(size_t index, size_t count) const;
+	Damage::Span pixels(const Damage::Span& region) const;
+	void collectBufferDamage(const Damage::Span& region);
+	void renderTags();
+	void clearDirty();
+
+	// low-level rendering
+	void beginFg();
+	void beginBg();
+	void renderComponent(BarComponent& component);
+public:
+	// buffers either holds one buffer for the whole bar, or one per BarRegion.
+	// All of them are as high as the bar.
+	RenderResult render(const BarSnapshot& snapshot, const std::vector<ShmBuffer::Buffer*>& buffers);
+};
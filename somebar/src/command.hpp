@@ -0,0 +1,55 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <optional>
+#include <string_view>
+#include <utility>
+
+enum class CommandType { Status, Show, Hide, Toggle };
+struct Command {
+	CommandType type;
+	// points into the parsed line
+	std::string_view arg;
+};
+
+constexpr std::string_view argAll {"all"};
+constexpr std::string_view argSelected {"selected"};
+
+// parses a line written to the status fifo, e.g. "toggle all".
+// this does not allocate and does not touch any wayland state.
+inline std::optional<Command> parseCommand(std::string_view line)
+{
+	constexpr std::pair<std::string_view, CommandType> prefixes[] = {
+		{"status ", CommandType::Status},
+		{"show ", CommandType::Show},
+		{"hide ", CommandType::Hide},
+		{"toggle ", CommandType::Toggle},
+	};
+	for (const auto& [prefix, type] : prefixes) {
+		if (line.substr(0, prefix.size()) == prefix) {
+			return Command {type, line.substr(prefix.size())};
+		}
+	}
+	return std::nullopt;
+}
+
+// queries are only available on the control socket, as the fifo cannot answer
+enum class Query { Monitors, Status, Stats, Subscribe, Unsubscribe };
+
+inline std::optional<Query> parseQuery(std::string_view line)
+{
+	constexpr std::pair<std::string_view, Query> queries[] = {
+		{"get monitors", Query::Monitors},
+		{"get status", Query::Status},
+		{"get stats", Query::Stats},
+		{"subscribe status", Query::Subscribe},
+		{"unsubscribe status", Query::Unsubscribe},
+	};
+	for (const auto& [text, query] : queries) {
+		if (line == text) {
+			return query;
+		}
+	}
+	return std::nullopt;
+}
@@ -9,6 +9,8 @@
 #include <linux/input-event-codes.h>
 #include <cairo/cairo.h>
 #include <pango/pango.h>
+#include "fractional-scale-v1-client-protocol.h"
+#include "viewporter-client-protocol.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 
 struct Color {
@@ -27,20 +29,45 @@ struct Monitor;
 
 enum TagState { None, Active = 0x01, Urgent = 0x02 };
 enum Control { ClkNone, ClkTagBar, ClkLayoutSymbol, ClkWinTitle, ClkStatusText };
+// for Button.btn: one press per scroll step, next to the codes from <linux/input-event-codes.h>
+enum ScrollButton { ScrollUp = 0x10000, ScrollDown, ScrollLeft, ScrollRight };
 struct Button {
 	int control;
 	int btn; // <linux/input-event-codes.h>
 	void (*func)(Monitor& mon, const Arg& arg);
 	const Arg arg;
+	int segment {-1}; // ClkStatusText only: the status segment, counted from 0. -1 for any
+};
+
+// kept between runs of a status block, see status_blocks.cpp
+struct StatusBlockState {
+	int fds[2] {-1, -1};
+	uint64_t prev[3] {};
+	std::string text;
+};
+struct StatusBlock {
+	void (*func)(StatusBlockState& state, const Arg& arg);
+	const Arg arg;
+	int interval; // seconds, runs are aligned to the wall clock
 };
 
 extern wl_display* display;
 extern wl_compositor* compositor;
 extern wl_shm* shm;
+extern wl_subcompositor* subcompositor;
+extern wp_viewporter* viewporter;
+extern wp_fractional_scale_manager_v1* fractionalScaleManager;
 extern zwlr_layer_shell_v1* wlrLayerShell;
 
 void spawn(Monitor&, const Arg& arg);
+void blockClock(StatusBlockState& state, const Arg& arg);
+void blockCpu(StatusBlockState& state, const Arg& arg);
+void blockMemory(StatusBlockState& state, const Arg& arg);
+void blockBattery(StatusBlockState& state, const Arg& arg);
+void blockNetwork(StatusBlockState& state, const Arg& arg);
 void setCloexec(int fd);
+// with -T, prints what happened when since somebar started
+void timelineMark(const char* what);
 [[noreturn]] void die(const char* why);
 [[noreturn]] void diesys(const char* why);
 
@@ -64,13 +91,18 @@ WL_DELETER(wl_buffer, wl_buffer_destroy);
 WL_DELETER(wl_output, wl_output_release_checked);
 WL_DELETER(wl_pointer, wl_pointer_release);
 WL_DELETER(wl_seat, wl_seat_release);
+WL_DELETER(wl_subsurface, wl_subsurface_destroy);
 WL_DELETER(wl_surface, wl_surface_destroy);
+WL_DELETER(wp_fractional_scale_v1, wp_fractional_scale_v1_destroy);
+WL_DELETER(wp_viewport, wp_viewport_destroy);
 WL_DELETER(zwlr_layer_surface_v1, zwlr_layer_surface_v1_destroy);
 
 WL_DELETER(cairo_t, cairo_destroy);
 WL_DELETER(cairo_surface_t, cairo_surface_destroy);
 
 WL_DELETER(PangoContext, g_object_unref);
+WL_DELETER(PangoFont, g_object_unref);
+WL_DELETER(PangoGlyphString, pango_glyph_string_free);
 WL_DELETER(PangoLayout, g_object_unref);
 
 #undef WL_DELETER
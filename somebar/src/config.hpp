@@ -6,6 +6,28 @@
 
 constexpr bool topbar = true;
 
+// accept dwl's binary status records instead of text lines, if dwl offers them
+constexpr bool binaryStatus = true;
+
+// only lay out the most recent status line once per frame, dropping the ones in between
+constexpr bool coalesceStatus = true;
+
+// shape and draw text on a separate thread, so that slow text can't hold up input handling
+constexpr bool renderThread = false;
+
+// shape short Latin text with harfbuzz directly instead of a full pango layout.
+// Text with other scripts, or glyphs the font lacks, always goes through pango.
+constexpr bool fastText = true;
+
+// give the tag strip, the title and the status subsurfaces and buffers of their
+// own, so that a change only replaces the buffer of its region. Each region's
+// buffers only cover its part of the bar, plus some room to grow, so this takes
+// little more shm memory than a single surface. Needs wp_viewporter.
+constexpr bool regionSubsurfaces = true;
+
+// upper limit for the memory used by pre-rendered components, shared by all bars
+constexpr size_t rasterCacheSize = 4 << 20;
+
 constexpr int paddingX = 10;
 constexpr int paddingY = 3;
 
@@ -18,6 +40,28 @@ constexpr const char* termcmd[] = {"wayst", nullptr};
 
 static std::vector<std::string> tagNames = {"1", "2", "3", "4", "5"};
 
+// the status is laid out in segments split at this delimiter, so only the
+// segments that changed are shaped again. Buttons can also match a single segment.
+// Leave it empty to lay out the status as one text.
+constexpr const char* statusDelimiter = "|";
+
+// scrolling on a touchpad counts as one ScrollUp or ScrollDown press per this
+// many units of wl_pointer.axis. A wheel sends one press per notch.
+constexpr double scrollStep = 15;
+
 constexpr Button buttons[] = {
 	{ClkStatusText,   BTN_RIGHT,  spawn,      {.v = termcmd} },
 };
+
+// built-in status blocks, shown from left to right. While this is empty, the
+// status text comes from stdin or the status fifo. For example:
+//	{blockCpu,      {0},                      2},
+//	{blockMemory,   {0},                      5},
+//	{blockBattery,  {.v = "BAT0"},           30},
+//	{blockNetwork,  {.v = "wlan0"},           2},
+//	{blockClock,    {.v = "%a %d %b %H:%M"}, 60},
+// blockClock takes a strftime format, blockBattery a power supply in
+// /sys/class/power_supply, blockNetwork an interface in /sys/class/net.
+static std::vector<StatusBlock> statusBlocks = {
+};
+constexpr const char* statusBlockSeparator = "  |  ";
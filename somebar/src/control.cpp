@@ -0,0 +1,135 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "control.hpp"
+
+ControlServer::ControlServer(Handler handler, FdCallback watch, FdCallback unwatch)
+	: _handler {std::move(handler)}
+	, _watch {std::move(watch)}
+	, _unwatch {std::move(unwatch)}
+{
+}
+
+ControlServer::~ControlServer()
+{
+	for (auto& client : _clients) {
+		close(client.fd);
+	}
+	if (_listenFd >= 0) {
+		close(_listenFd);
+	}
+}
+
+void ControlServer::listen(const std::string& path)
+{
+	auto addr = sockaddr_un {};
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		die("control socket path too long");
+	}
+	std::copy(path.begin(), path.end(), addr.sun_path);
+
+	_listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (_listenFd < 0) {
+		diesys("socket");
+	}
+	// we own the fifo next to it, so a socket file at this path is left over from a crash
+	::unlink(path.c_str());
+	if (bind(_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+		diesys("bind control socket");
+	}
+	if (::listen(_listenFd, 16) < 0) {
+		diesys("listen");
+	}
+	_path = path;
+	_watch(_listenFd);
+}
+
+void ControlServer::dispatch(int fd)
+{
+	if (fd == _listenFd) {
+		while (true) {
+			auto clientFd = accept4(_listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+			if (clientFd < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED) {
+					perror("accept control client");
+				}
+				return;
+			}
+			_clients.push_back({clientFd});
+			_watch(clientFd);
+		}
+	}
+
+	auto client = std::find_if(_clients.begin(), _clients.end(), [fd](const auto& c) { return c.fd == fd; });
+	if (client == _clients.end()) {
+		return;
+	}
+	static std::array<char, 64*1024> packet;
+	while (true) {
+		auto n = recv(fd, packet.data(), packet.size(), MSG_TRUNC);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return;
+		}
+		if (n <= 0) {
+			disconnect(client);
+			return;
+		}
+		auto reply = static_cast<size_t>(n) > packet.size()
+			? std::string {"error: packet too large\n"}
+			: _handler(*client, {packet.data(), static_cast<size_t>(n)});
+		if (!this->reply(fd, reply)) {
+			disconnect(client);
+			return;
+		}
+	}
+}
+
+void ControlServer::broadcast(std::string_view packet)
+{
+	// this may run while dispatch() handles a packet, so clients are not removed
+	// here. A client that is gone will be reaped once its hangup is dispatched.
+	for (auto& client : _clients) {
+		if (client.subscribed && !send(client.fd, packet)) {
+			client.subscribed = false;
+		}
+	}
+}
+
+// returns false if the reply could not be sent right away. The client waits for
+// it, so it is disconnected then instead of waiting forever.
+bool ControlServer::reply(int fd, std::string_view packet)
+{
+	auto res = ::send(fd, packet.data(), packet.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+	return res >= 0;
+}
+
+// returns false if the client is gone. A subscriber that is too slow to read
+// misses broadcasts instead of blocking the bar.
+bool ControlServer::send(int fd, std::string_view packet)
+{
+	auto res = ::send(fd, packet.data(), packet.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+	return res >= 0 || errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+void ControlServer::disconnect(std::list<ControlClient>::iterator client)
+{
+	_unwatch(client->fd);
+	close(client->fd);
+	_clients.erase(client);
+}
+
+void ControlServer::unlink()
+{
+	if (!_path.empty()) {
+		::unlink(_path.c_str());
+	}
+}
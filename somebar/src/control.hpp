@@ -0,0 +1,48 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <functional>
+#include <list>
+#include <string>
+#include <string_view>
+
+struct ControlClient {
+	int fd;
+	bool subscribed {false};
+};
+
+// a SOCK_SEQPACKET control socket. Every packet a client sends is one batch of
+// newline-separated commands, and is answered with exactly one packet.
+// Subscribed clients additionally receive the packets passed to broadcast().
+class ControlServer {
+public:
+	// returns the reply to a packet
+	using Handler = std::function<std::string(ControlClient& client, std::string_view packet)>;
+	// called when an fd needs a readable callback in the event loop, or no longer does
+	using FdCallback = std::function<void(int fd)>;
+private:
+	Handler _handler;
+	FdCallback _watch, _unwatch;
+	std::string _path;
+	int _listenFd {-1};
+	std::list<ControlClient> _clients;
+
+	void disconnect(std::list<ControlClient>::iterator client);
+	bool reply(int fd, std::string_view packet);
+	bool send(int fd, std::string_view packet);
+public:
+	ControlServer(Handler handler, FdCallback watch, FdCallback unwatch);
+	ControlServer(const ControlServer&) = delete;
+	ControlServer& operator=(const ControlServer&) = delete;
+	~ControlServer();
+
+	// binds the socket and starts accepting clients. Replaces a stale socket at path.
+	void listen(const std::string& path);
+	const std::string& path() const { return _path; }
+	// call from the readable callback of an fd passed to watch
+	void dispatch(int fd);
+	void broadcast(std::string_view packet);
+	// removes the socket file
+	void unlink();
+};
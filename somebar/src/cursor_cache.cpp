@@ -0,0 +1,125 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <cstdio>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "cursor_cache.hpp"
+
+// in surface coordinates, the theme is loaded at this times the scale
+constexpr int cursorSize = 24;
+
+CursorCache::CursorCache(EventLoop& loop, std::function<void()> onLoaded)
+	: _loop {loop}
+	, _onLoaded {std::move(onLoaded)}
+{
+	_eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (_eventFd < 0) {
+		diesys("eventfd");
+	}
+	_loop.add(_eventFd, EPOLLIN, [this](uint32_t) { deliver(); });
+	_thread = std::thread {[this]() { run(); }};
+}
+
+CursorCache::~CursorCache()
+{
+	{
+		auto lock = std::unique_lock {_mutex};
+		_stopping = true;
+	}
+	_wake.notify_one();
+	_thread.join();
+	_loop.remove(_eventFd);
+	close(_eventFd);
+	// themes that were never delivered, which may have failed to load
+	for (auto& loaded : _loaded) {
+		if (loaded.theme) {
+			_themes.push_back(loaded.theme);
+		}
+	}
+	for (auto& [scale, cursor] : _cursors) {
+		if (cursor.surface) {
+			wl_surface_destroy(cursor.surface);
+		}
+	}
+	for (auto theme : _themes) {
+		wl_cursor_theme_destroy(theme);
+	}
+}
+
+void CursorCache::preload(int scale)
+{
+	if (_cursors.count(scale)) {
+		return;
+	}
+	_cursors[scale] = Cursor {};
+	{
+		auto lock = std::unique_lock {_mutex};
+		_requests.push_back(scale);
+	}
+	_wake.notify_one();
+}
+
+const CursorCache::Cursor* CursorCache::get(int scale)
+{
+	preload(scale);
+	auto& cursor = _cursors[scale];
+	return cursor.surface ? &cursor : nullptr;
+}
+
+void CursorCache::run()
+{
+	auto lock = std::unique_lock {_mutex};
+	while (true) {
+		_wake.wait(lock, [&]() { return _stopping || !_requests.empty(); });
+		if (_stopping) {
+			break;
+		}
+		auto scale = _requests.front();
+		_requests.pop_front();
+		lock.unlock();
+
+		// reads and decodes every cursor of the theme. wayland-client is thread
+		// safe, so it may create its shm pool from here.
+		auto theme = wl_cursor_theme_load(nullptr, cursorSize * scale, shm);
+
+		lock.lock();
+		_loaded.push_back(Loaded {scale, theme});
+		uint64_t one = 1;
+		[[maybe_unused]] auto res = write(_eventFd, &one, sizeof(one));
+	}
+}
+
+// runs on the main thread when the eventfd fires
+void CursorCache::deliver()
+{
+	uint64_t count;
+	if (read(_eventFd, &count, sizeof(count)) < 0) {
+		return;
+	}
+	auto loaded = std::vector<Loaded> {};
+	{
+		auto lock = std::unique_lock {_mutex};
+		loaded.swap(_loaded);
+	}
+	for (auto& [scale, theme] : loaded) {
+		if (!theme) {
+			fprintf(stderr, "somebar: could not load the cursor theme\n");
+			continue;
+		}
+		_themes.push_back(theme);
+		auto cursor = wl_cursor_theme_get_cursor(theme, "left_ptr");
+		if (!cursor || !cursor->image_count) {
+			fprintf(stderr, "somebar: the cursor theme has no left_ptr cursor\n");
+			continue;
+		}
+		auto image = cursor->images[0];
+		auto surface = wl_compositor_create_surface(compositor);
+		wl_surface_set_buffer_scale(surface, scale);
+		wl_surface_attach(surface, wl_cursor_image_get_buffer(image), 0, 0);
+		wl_surface_commit(surface);
+		_cursors[scale] = Cursor {surface,
+			static_cast<int>(image->hotspot_x) / scale, static_cast<int>(image->hotspot_y) / scale};
+	}
+	_onLoaded();
+}
@@ -0,0 +1,60 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <wayland-cursor.h>
+#include "common.hpp"
+#include "event_loop.hpp"
+
+// loads the cursor theme on a thread of its own, once per scale, so that the
+// pointer listener never waits for the theme to be read from disk. Loaded
+// themes are handed to the main thread through an eventfd in the event loop.
+// Every seat shares the cursors.
+class CursorCache {
+public:
+	struct Cursor {
+		// has the cursor image attached, with the scale as its buffer scale
+		wl_surface* surface;
+		// in surface coordinates
+		int hotspotX, hotspotY;
+	};
+private:
+	struct Loaded {
+		int scale;
+		wl_cursor_theme* theme;
+	};
+	EventLoop& _loop;
+	std::function<void()> _onLoaded;
+	int _eventFd {-1};
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::deque<int> _requests;
+	std::vector<Loaded> _loaded;
+	bool _stopping {false};
+	// only touched by the main thread. Scales that are still loading map to
+	// an entry without a surface.
+	std::unordered_map<int, Cursor> _cursors;
+	std::vector<wl_cursor_theme*> _themes;
+
+	void run();
+	void deliver();
+public:
+	// onLoaded is called on the main thread whenever a theme finished loading
+	CursorCache(EventLoop& loop, std::function<void()> onLoaded);
+	CursorCache(const CursorCache&) = delete;
+	CursorCache& operator=(const CursorCache&) = delete;
+	~CursorCache();
+
+	// starts loading the theme for an integer scale, unless it is loaded or loading
+	void preload(int scale);
+	// returns nullptr while the theme is loading, and starts loading it if needed
+	const Cursor* get(int scale);
+};
@@ -0,0 +1,77 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <algorithm>
+#include <vector>
+
+// the parts of the bar that need to be repainted. The bar is a single row, so
+// damage is a set of x ranges that always cover the full height.
+class Damage {
+public:
+	struct Span {
+		int x, width;
+	};
+private:
+	// sorted and non-overlapping. There are only ever a handful, so a vector is fine.
+	std::vector<Span> _spans;
+public:
+	void add(int x, int width)
+	{
+		if (width <= 0) {
+			return;
+		}
+		auto end = x + width;
+		auto it = _spans.begin();
+		while (it != _spans.end() && it->x + it->width < x) {
+			it++;
+		}
+		// merge every span that touches [x, end)
+		auto last = it;
+		while (last != _spans.end() && last->x <= end) {
+			x = std::min(x, last->x);
+			end = std::max(end, last->x + last->width);
+			last++;
+		}
+		it = _spans.erase(it, last);
+		_spans.insert(it, Span {x, end - x});
+	}
+	void add(const Damage& other)
+	{
+		for (const auto& span : other._spans) {
+			add(span.x, span.width);
+		}
+	}
+	// drops everything outside of [x, x+width)
+	void clip(int x, int width)
+	{
+		auto end = x + width;
+		auto out = _spans.begin();
+		for (const auto& span : _spans) {
+			auto from = std::max(span.x, x);
+			auto to = std::min(span.x + span.width, end);
+			if (from < to) {
+				*out++ = Span {from, to - from};
+			}
+		}
+		_spans.erase(out, _spans.end());
+	}
+	void translate(int dx)
+	{
+		for (auto& span : _spans) {
+			span.x += dx;
+		}
+	}
+	bool intersects(int x, int width) const
+	{
+		for (const auto& span : _spans) {
+			if (span.x < x + width && x < span.x + span.width) {
+				return true;
+			}
+		}
+		return false;
+	}
+	bool empty() const { return _spans.empty(); }
+	void clear() { _spans.clear(); }
+	const std::vector<Span>& spans() const { return _spans; }
+};
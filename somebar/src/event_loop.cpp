@@ -0,0 +1,156 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include "common.hpp"
+#include "event_loop.hpp"
+
+EventLoop::EventLoop()
+{
+	_epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epollFd < 0) {
+		diesys("epoll_create1");
+	}
+}
+
+EventLoop::~EventLoop()
+{
+	close(_epollFd);
+}
+
+bool EventLoop::add(int fd, uint32_t events, Callback callback)
+{
+	auto id = _nextId++;
+	auto ev = epoll_event {};
+	ev.events = events;
+	ev.data.u64 = id;
+	if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		if (errno == EPERM) {
+			return false;
+		}
+		diesys("epoll_ctl add");
+	}
+	_sources.emplace(id, Source {fd, std::move(callback)});
+	_idByFd[fd] = id;
+	return true;
+}
+
+void EventLoop::modify(int fd, uint32_t events)
+{
+	auto ev = epoll_event {};
+	ev.events = events;
+	ev.data.u64 = _idByFd.at(fd);
+	if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+		diesys("epoll_ctl mod");
+	}
+}
+
+void EventLoop::remove(int fd)
+{
+	auto it = _idByFd.find(fd);
+	if (it == _idByFd.end()) {
+		return;
+	}
+	epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	// the callback may be running right now, so it is destroyed after the dispatch.
+	// the id keeps events that were already returned for fd from reaching a new source.
+	_sources.at(it->second).removed = true;
+	_removed.push_back(it->second);
+	_idByFd.erase(it);
+}
+
+int EventLoop::addTimer(clockid_t clock, std::function<void()> callback)
+{
+	auto fd = timerfd_create(clock, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		diesys("timerfd_create");
+	}
+	add(fd, EPOLLIN, [fd, callback = std::move(callback)](uint32_t) {
+		uint64_t expirations;
+		// ECANCELED means the clock was set under a TFD_TIMER_CANCEL_ON_SET timer,
+		// which the callback has to re-arm
+		if (read(fd, &expirations, sizeof(expirations)) > 0 || errno == ECANCELED) {
+			callback();
+		}
+	});
+	return fd;
+}
+
+void EventLoop::armTimer(int timerFd, timespec initial, timespec interval, int flags)
+{
+	auto spec = itimerspec {interval, initial};
+	if (timerfd_settime(timerFd, flags, &spec, nullptr) < 0) {
+		diesys("timerfd_settime");
+	}
+}
+
+void EventLoop::removeTimer(int timerFd)
+{
+	remove(timerFd);
+	close(timerFd);
+}
+
+void EventLoop::addSignals(std::initializer_list<int> signals, std::function<void(int signal)> callback)
+{
+	sigset_t mask;
+	sigemptyset(&mask);
+	for (auto signal : signals) {
+		sigaddset(&mask, signal);
+	}
+	if (sigprocmask(SIG_BLOCK, &mask, nullptr) < 0) {
+		diesys("sigprocmask");
+	}
+	auto fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd < 0) {
+		diesys("signalfd");
+	}
+	add(fd, EPOLLIN, [fd, callback = std::move(callback)](uint32_t) {
+		signalfd_siginfo info;
+		while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+			callback(info.ssi_signo);
+		}
+	});
+}
+
+void EventLoop::setHooks(Hook beforeWait, Hook afterDispatch)
+{
+	_beforeWait = std::move(beforeWait);
+	_afterDispatch = std::move(afterDispatch);
+}
+
+void EventLoop::run()
+{
+	std::array<epoll_event, 16> events;
+	while (!_quitting) {
+		if (_beforeWait) {
+			_beforeWait();
+		}
+		auto n = epoll_wait(_epollFd, events.data(), events.size(), -1);
+		if (n < 0 && errno != EINTR) {
+			diesys("epoll_wait");
+		}
+		for (auto i = 0; i < n; i++) {
+			auto source = _sources.find(events[i].data.u64);
+			if (source != _sources.end() && !source->second.removed) {
+				source->second.callback(events[i].events);
+			}
+		}
+		if (_afterDispatch) {
+			_afterDispatch();
+		}
+		for (auto id : _removed) {
+			_sources.erase(id);
+		}
+		_removed.clear();
+	}
+}
+
+void EventLoop::quit()
+{
+	_quitting = true;
+}
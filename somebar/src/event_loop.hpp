@@ -0,0 +1,57 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <initializer_list>
+#include <unordered_map>
+#include <vector>
+#include <sys/epoll.h>
+
+// maps fds to callbacks, using epoll. Timers and signals are fds as well, using
+// timerfd and signalfd. Sources may be added and removed from within callbacks.
+class EventLoop {
+public:
+	using Callback = std::function<void(uint32_t events)>;
+	using Hook = std::function<void()>;
+private:
+	struct Source {
+		int fd;
+		Callback callback;
+		bool removed {false};
+	};
+	int _epollFd {-1};
+	uint64_t _nextId {0};
+	std::unordered_map<uint64_t, Source> _sources;
+	std::unordered_map<int, uint64_t> _idByFd;
+	std::vector<uint64_t> _removed;
+	Hook _beforeWait, _afterDispatch;
+	bool _quitting {false};
+public:
+	EventLoop();
+	EventLoop(const EventLoop&) = delete;
+	EventLoop& operator=(const EventLoop&) = delete;
+	~EventLoop();
+
+	// returns false and sets errno if fd can't be polled, e.g. EPERM for regular files
+	bool add(int fd, uint32_t events, Callback callback);
+	void modify(int fd, uint32_t events);
+	// the caller still owns fd
+	void remove(int fd);
+
+	// creates a disarmed timerfd on clock and returns it
+	int addTimer(clockid_t clock, std::function<void()> callback);
+	// interval 0 means one-shot. flags are timerfd_settime flags, e.g. TFD_TIMER_ABSTIME.
+	void armTimer(int timerFd, timespec initial, timespec interval = {}, int flags = 0);
+	void removeTimer(int timerFd);
+
+	// blocks signals and delivers them through a signalfd
+	void addSignals(std::initializer_list<int> signals, std::function<void(int signal)> callback);
+
+	// beforeWait runs before every wait, afterDispatch after the callbacks of every wakeup
+	void setHooks(Hook beforeWait, Hook afterDispatch);
+	void run();
+	void quit();
+};
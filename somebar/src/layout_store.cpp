@@ -0,0 +1,259 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <algorithm>
+#include <hb.h>
+#include <pango/pangocairo.h>
+#include "layout_store.hpp"
+
+int SharedLayout::width() const
+{
+	if (pangoLayout) {
+		int w, h;
+		pango_layout_get_size(pangoLayout.get(), &w, &h);
+		return PANGO_PIXELS(w);
+	}
+	return PANGO_PIXELS(logical.width);
+}
+
+void SharedLayout::draw(cairo_t* painter) const
+{
+	if (pangoLayout) {
+		pango_cairo_show_layout(painter, pangoLayout.get());
+		return;
+	}
+	// pango_cairo_show_layout starts at the top left, a glyph string at the baseline
+	double x, y;
+	cairo_get_current_point(painter, &x, &y);
+	cairo_move_to(painter, x, y - pango_units_to_double(logical.y));
+	pango_cairo_show_glyph_string(painter, font, glyphs.get());
+}
+
+LayoutStore::LayoutStore(const PangoFontDescription* font, bool fastText)
+	: _fontDescription {font}
+	, _fastText {fastText}
+{
+}
+
+// ellipsized layouts kept alive by a store, see _recentEllipsized
+constexpr size_t recentEllipsized = 8;
+
+std::shared_ptr<const SharedLayout> LayoutStore::get(std::string_view text, int maxWidth)
+{
+	if (maxWidth >= 0) {
+		auto it = _ellipsized.find(std::pair {text, maxWidth});
+		if (it != _ellipsized.end()) {
+			return it->second.lock();
+		}
+		// text that fits does not depend on the width, so it is not shaped again
+		// whenever the width changes
+		if (auto layout = getFitting(text, maxWidth)) {
+			return layout;
+		}
+		auto layout = create(text, maxWidth);
+		ellipsize(*layout);
+		_ellipsized.emplace(std::pair {std::string_view {layout->text}, maxWidth}, layout);
+		_recentEllipsized.push_back(layout);
+		if (_recentEllipsized.size() > recentEllipsized) {
+			_recentEllipsized.pop_front();
+		}
+		return layout;
+	}
+	auto it = _layouts.find(text);
+	if (it != _layouts.end()) {
+		return it->second.lock();
+	}
+	auto layout = create(text, maxWidth);
+	if (!_fastText || !shapeSimple(*layout, layout->text)) {
+		layout->pangoLayout.reset(pango_layout_new(_context.get()));
+		pango_layout_set_font_description(layout->pangoLayout.get(), _fontDescription);
+		pango_layout_set_text(layout->pangoLayout.get(), layout->text.c_str(), layout->text.size());
+	}
+	_layouts.emplace(layout->text, layout);
+	return layout;
+}
+
+// the layout of all of text, if it fits into maxWidth. Text with more
+// characters than could ever fit is not shaped in full.
+std::shared_ptr<const SharedLayout> LayoutStore::getFitting(std::string_view text, int maxWidth)
+{
+	auto layout = std::shared_ptr<const SharedLayout> {};
+	auto it = _layouts.find(text);
+	if (it != _layouts.end()) {
+		layout = it->second.lock();
+	} else {
+		if (!_context) {
+			createContext();
+		}
+		if (visiblePrefix(text, maxWidth) == text.size()) {
+			layout = get(text);
+		}
+	}
+	if (layout && layout->width() <= maxWidth) {
+		return layout;
+	}
+	return nullptr;
+}
+
+// returns a layout that is not shaped yet, and removes itself from the store once unused
+std::shared_ptr<SharedLayout> LayoutStore::create(std::string_view text, int maxWidth)
+{
+	if (!_context) {
+		createContext();
+	}
+	auto layout = std::shared_ptr<SharedLayout> {new SharedLayout {}, [this](SharedLayout* l) {
+		if (l->maxWidth >= 0) {
+			_ellipsized.erase(std::pair {std::string_view {l->text}, l->maxWidth});
+		} else {
+			_layouts.erase(l->text);
+		}
+		delete l;
+	}};
+	layout->text.assign(text);
+	layout->maxWidth = maxWidth;
+	return layout;
+}
+
+void LayoutStore::createContext()
+{
+	// created lazily, as the font map is not ready during static initialization
+	_context.reset(pango_font_map_create_context(pango_cairo_font_map_get_default()));
+	if (!_context) {
+		die("pango_font_map_create_context");
+	}
+	// take the font options of the image surfaces everything is drawn into.
+	// They never change, so this is the only pango_cairo_update_context.
+	auto surface = wl_unique_ptr<cairo_surface_t> {cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1)};
+	auto painter = wl_unique_ptr<cairo_t> {cairo_create(surface.get())};
+	pango_cairo_update_context(painter.get(), _context.get());
+	_font.reset(pango_font_map_load_font(pango_context_get_font_map(_context.get()), _context.get(), _fontDescription));
+	if (_font) {
+		// even narrow glyphs like i or a space are wider than a quarter of the average
+		auto metrics = pango_font_get_metrics(_font.get(), pango_language_get_default());
+		_minCharWidth = std::max(PANGO_PIXELS_FLOOR(pango_font_metrics_get_approximate_char_width(metrics) / 4), 1);
+		pango_font_metrics_unref(metrics);
+	}
+}
+
+// the length of the part of text that can be visible within maxWidth pixels,
+// with one character to spare
+size_t LayoutStore::visiblePrefix(std::string_view text, int maxWidth) const
+{
+	auto maxChars = static_cast<size_t>(maxWidth / _minCharWidth + 1);
+	auto chars = size_t {0};
+	auto cut = size_t {0};
+	while (cut < text.size() && chars <= maxChars) {
+		cut++;
+		while (cut < text.size() && (text[cut] & 0xc0) == 0x80) {
+			cut++;
+		}
+		chars++;
+	}
+	return cut;
+}
+
+// shapes no more characters than can fit into maxWidth, and lets pango cut
+// that down to the width. Titles can be much longer than the bar.
+void LayoutStore::ellipsize(SharedLayout& layout)
+{
+	auto text = std::string_view {layout.text};
+	auto cut = visiblePrefix(text, layout.maxWidth);
+	auto shaped = std::string {};
+	if (cut < text.size()) {
+		// if it fits after all, e.g. with many combining characters, still show that it was cut
+		shaped.reserve(cut + 3);
+		shaped.append(text.substr(0, cut));
+		shaped.append("\u2026");
+		text = shaped;
+	}
+	if (_fastText && shapeSimple(layout, text)) {
+		if (layout.width() <= layout.maxWidth) {
+			return;
+		}
+		layout.glyphs.reset();
+		layout.font = nullptr;
+	}
+	layout.pangoLayout.reset(pango_layout_new(_context.get()));
+	pango_layout_set_font_description(layout.pangoLayout.get(), _fontDescription);
+	pango_layout_set_width(layout.pangoLayout.get(), layout.maxWidth * PANGO_SCALE);
+	pango_layout_set_ellipsize(layout.pangoLayout.get(), PANGO_ELLIPSIZE_END);
+	pango_layout_set_text(layout.pangoLayout.get(), text.data(), text.size());
+}
+
+// true for text that pango would lay out as a single left-to-right run in the
+// bar font: printable Latin only, so there is no bidi, no complex shaping and
+// no need to look at other fonts.
+static bool isSimpleText(std::string_view text)
+{
+	for (auto i = size_t {0}; i < text.size(); ) {
+		auto c = static_cast<unsigned char>(text[i]);
+		uint32_t cp;
+		if (c < 0x80) {
+			cp = c;
+			i++;
+		} else if ((c & 0xe0) == 0xc0 && i + 1 < text.size() && (text[i+1] & 0xc0) == 0x80) {
+			cp = (c & 0x1f) << 6 | (text[i+1] & 0x3f);
+			i += 2;
+			if (cp < 0x80) {
+				// overlong encoding, which pango treats as invalid
+				return false;
+			}
+		} else {
+			// everything up to U+024F fits in two bytes
+			return false;
+		}
+		if (cp < 0x20 || (cp >= 0x7f && cp < 0xa0) || cp > 0x24f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// shapes the text like pango does for a single run, but without itemizing
+// it first. Returns false if pango has to do it, e.g. if the font lacks a glyph.
+bool LayoutStore::shapeSimple(SharedLayout& layout, std::string_view text)
+{
+	if (!_font || !isSimpleText(text)) {
+		return false;
+	}
+	auto hbFont = pango_font_get_hb_font(_font.get());
+	if (!hbFont) {
+		return false;
+	}
+	auto buf = hb_buffer_create();
+	hb_buffer_add_utf8(buf, text.data(), text.size(), 0, text.size());
+	hb_buffer_set_direction(buf, HB_DIRECTION_LTR);
+	hb_buffer_set_script(buf, HB_SCRIPT_LATIN);
+	hb_buffer_set_language(buf, hb_language_from_string(pango_language_to_string(pango_language_get_default()), -1));
+	hb_shape(hbFont, buf, nullptr, 0);
+
+	auto count = 0u;
+	auto infos = hb_buffer_get_glyph_infos(buf, &count);
+	auto positions = hb_buffer_get_glyph_positions(buf, &count);
+	auto glyphs = wl_unique_ptr<PangoGlyphString> {pango_glyph_string_new()};
+	pango_glyph_string_set_size(glyphs.get(), count);
+	auto ok = true;
+	for (auto i = 0u; i < count; i++) {
+		if (!infos[i].codepoint) {
+			// missing glyph, pango would pick a fallback font
+			ok = false;
+			break;
+		}
+		// pango's hb fonts work in pango units, and pango rounds positions to whole pixels
+		auto& glyph = glyphs->glyphs[i];
+		glyph.glyph = infos[i].codepoint;
+		glyph.geometry.width = PANGO_UNITS_ROUND(positions[i].x_advance);
+		glyph.geometry.x_offset = PANGO_UNITS_ROUND(positions[i].x_offset);
+		glyph.geometry.y_offset = PANGO_UNITS_ROUND(-positions[i].y_offset);
+		glyph.attr.is_cluster_start = i == 0 || infos[i].cluster != infos[i-1].cluster;
+		glyphs->log_clusters[i] = infos[i].cluster;
+	}
+	hb_buffer_destroy(buf);
+	if (!ok) {
+		return false;
+	}
+	layout.font = _font.get();
+	pango_glyph_string_extents(glyphs.get(), layout.font, nullptr, &layout.logical);
+	layout.glyphs = std::move(glyphs);
+	return true;
+}
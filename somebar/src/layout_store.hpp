@@ -0,0 +1,67 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include "common.hpp"
+
+// shaped text. Simple text is shaped with harfbuzz directly into a glyph
+// string, everything else goes through a PangoLayout. Exactly one of
+// pangoLayout and glyphs is set.
+struct SharedLayout {
+	std::string text;
+	wl_unique_ptr<PangoLayout> pangoLayout;
+	wl_unique_ptr<PangoGlyphString> glyphs;
+	PangoFont* font {nullptr};
+	PangoRectangle logical {};
+	// in pixels. If not -1, the text was too wide and is ellipsized at the end to fit.
+	int maxWidth {-1};
+
+	// in pixels
+	int width() const;
+	// draws the text with its top left corner at the current point
+	void draw(cairo_t* painter) const;
+};
+
+// hands out one shaped layout per distinct text, shared by every bar that
+// shows it. A layout is destroyed once no component uses it anymore.
+class LayoutStore {
+	wl_unique_ptr<PangoContext> _context;
+	wl_unique_ptr<PangoFont> _font;
+	const PangoFontDescription* _fontDescription;
+	// shape simple text with harfbuzz, see shapeSimple()
+	bool _fastText;
+	// in pixels, a lower bound for the advance of a character
+	int _minCharWidth {1};
+	// keys point into SharedLayout::text
+	std::unordered_map<std::string_view, std::weak_ptr<SharedLayout>> _layouts;
+	// ellipsized layouts, by text and maxWidth
+	std::map<std::pair<std::string_view, int>, std::weak_ptr<SharedLayout>> _ellipsized;
+	// the most recently ellipsized layouts are kept alive, so a width that comes
+	// back, e.g. when the status grows and shrinks again, finds its layout
+	std::deque<std::shared_ptr<const SharedLayout>> _recentEllipsized;
+
+	void createContext();
+	std::shared_ptr<SharedLayout> create(std::string_view text, int maxWidth);
+	std::shared_ptr<const SharedLayout> getFitting(std::string_view text, int maxWidth);
+	size_t visiblePrefix(std::string_view text, int maxWidth) const;
+	void ellipsize(SharedLayout& layout);
+	bool shapeSimple(SharedLayout& layout, std::string_view text);
+public:
+	// fastText is usually the one from config.hpp, the tests compare both ways
+	LayoutStore(const PangoFontDescription* font, bool fastText);
+	LayoutStore(const LayoutStore&) = delete;
+	LayoutStore& operator=(const LayoutStore&) = delete;
+
+	// with a maxWidth in pixels, the text is ellipsized to fit into it. Only the
+	// part of the text that can be visible is shaped. Text that fits as it is
+	// gets the same layout as without a maxWidth, whose maxWidth is -1.
+	std::shared_ptr<const SharedLayout> get(std::string_view text, int maxWidth = -1);
+	size_t size() const { return _layouts.size() + _ellipsized.size(); }
+};
@@ -4,68 +4,120 @@
 #pragma once
 #include <array>
 #include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 #include <sys/types.h>
 
 // reads data from Reader, and passes complete lines to Consumer.
-template<size_t BufSize>
+// if Consumer returns bool, returning false stops dispatching. The unconsumed
+// bytes then stay in the buffer until they are taken with takeBuffered().
+//
+// the buffer starts out with BufSize bytes. If MaxSize is larger, it doubles
+// whenever a single line does not fit, up to MaxSize. Lines longer than the
+// buffer are discarded.
+//
+// the partial line at the end of a read is only moved to the front once the
+// free space behind it runs out, and bytes are never scanned for a newline twice.
+template<size_t BufSize, size_t MaxSize = BufSize>
 class LineBuffer {
-	using Iterator = typename std::array<char, BufSize>::iterator;
-	std::array<char, BufSize> _buffer;
-	Iterator _bufferedTo;
-	Iterator _consumedTo;
+	static_assert(MaxSize >= BufSize);
+	static constexpr bool Growable = MaxSize > BufSize;
+	using Storage = std::conditional_t<Growable, std::vector<char>, std::array<char, BufSize>>;
+	Storage _buffer {};
+	size_t _consumedTo {0};
+	size_t _scannedTo {0};
+	size_t _bufferedTo {0};
 	bool _discardLine {false};
 public:
 	LineBuffer()
-		: _bufferedTo {_buffer.begin()}
-		, _consumedTo {_buffer.begin()}
 	{
+		if constexpr (Growable) {
+			_buffer.resize(BufSize);
+		}
 	}
 
 	template<typename Reader, typename Consumer>
 	ssize_t readLines(const Reader& reader, const Consumer& consumer)
 	{
 		while (true) {
-			auto bytesRead = reader(_bufferedTo, _buffer.end() - _bufferedTo);
+			makeRoom();
+			auto bytesRead = reader(_buffer.data() + _bufferedTo, _buffer.size() - _bufferedTo);
 			if (bytesRead <= 0) {
 				return bytesRead;
 			}
 			_bufferedTo += bytesRead;
-			dispatchLines(consumer);
-			resetBuffer();
+			if (!dispatchLines(consumer)) {
+				return bytesRead;
+			}
 		}
 	}
+
+	// returns the bytes after the last dispatched line and empties the buffer
+	std::string_view takeBuffered()
+	{
+		auto res = std::string_view {_buffer.data() + _consumedTo, _bufferedTo - _consumedTo};
+		_consumedTo = _scannedTo = _bufferedTo = 0;
+		return res;
+	}
 private:
 	template<typename Consumer>
-	void dispatchLines(const Consumer& consumer)
+	bool dispatchLines(const Consumer& consumer)
 	{
 		while (true) {
-			auto separator = std::find(_consumedTo, _bufferedTo, '\n');
-			if (separator == _bufferedTo) {
+			// memchr is vectorized by the libc, which beats a byte-wise std::find
+			auto begin = _buffer.data() + _scannedTo;
+			auto separator = static_cast<char*>(memchr(begin, '\n', _bufferedTo - _scannedTo));
+			if (!separator) {
+				_scannedTo = _bufferedTo;
 				break;
 			}
-			size_t lineLength = separator - _consumedTo;
-			if (!_discardLine) {
-				consumer(_consumedTo, lineLength);
-			}
-			_consumedTo = separator + 1;
+			auto line = _buffer.data() + _consumedTo;
+			size_t lineLength = separator - line;
+			auto discard = _discardLine;
+			_consumedTo = _scannedTo = separator - _buffer.data() + 1;
 			_discardLine = false;
+			if (discard) {
+				continue;
+			}
+			if constexpr (std::is_same_v<decltype(consumer(line, lineLength)), bool>) {
+				if (!consumer(line, lineLength)) {
+					return false;
+				}
+			} else {
+				consumer(line, lineLength);
+			}
+		}
+		if (_consumedTo == _bufferedTo) {
+			_consumedTo = _scannedTo = _bufferedTo = 0;
 		}
+		return true;
 	}
 
-	void resetBuffer()
+	// makes sure there is space to read into after _bufferedTo
+	void makeRoom()
 	{
-		size_t bytesRemaining = _bufferedTo - _consumedTo;
-		if (bytesRemaining == _buffer.size()) {
-			// line too long
-			_discardLine = true;
-			_consumedTo = _buffer.begin();
-			_bufferedTo = _buffer.begin();
-		} else {
-			// move the last partial message to the front of the buffer, so a full-sized
-			// message will fit
-			std::copy(_consumedTo, _bufferedTo, _buffer.begin());
-			_consumedTo = _buffer.begin();
-			_bufferedTo = _consumedTo + bytesRemaining;
+		if (_bufferedTo < _buffer.size()) {
+			return;
+		}
+		if (_consumedTo > 0) {
+			// move the last partial line to the front of the buffer
+			auto bytesRemaining = _bufferedTo - _consumedTo;
+			memmove(_buffer.data(), _buffer.data() + _consumedTo, bytesRemaining);
+			_scannedTo -= _consumedTo;
+			_consumedTo = 0;
+			_bufferedTo = bytesRemaining;
+			return;
+		}
+		if constexpr (Growable) {
+			if (_buffer.size() < MaxSize) {
+				_buffer.resize(std::min(_buffer.size() * 2, MaxSize));
+				return;
+			}
 		}
+		// line too long
+		_discardLine = true;
+		_consumedTo = _scannedTo = _bufferedTo = 0;
 	}
 };
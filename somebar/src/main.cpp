@@ -2,45 +2,60 @@
 // See LICENSE file for copyright and license details.
 
 #include <algorithm>
+#include <charconv>
 #include <cstdio>
-#include <sstream>
+#include <cstdlib>
+#include <ctime>
 #include <list>
 #include <optional>
+#include <string_view>
 #include <utility>
 #include <vector>
 #include <fcntl.h>
-#include <poll.h>
 #include <signal.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <linux/input-event-codes.h>
 #include <wayland-client.h>
-#include <wayland-cursor.h>
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 #include "xdg-output-unstable-v1-client-protocol.h"
 #include "xdg-shell-client-protocol.h"
 #include "common.hpp"
 #include "config.hpp"
 #include "bar.hpp"
+#include "command.hpp"
+#include "control.hpp"
+#include "cursor_cache.hpp"
+#include "event_loop.hpp"
 #include "line_buffer.hpp"
-
-struct Monitor {
-	uint32_t registryName;
-	std::string xdgName;
-	wl_unique_ptr<wl_output> wlOutput;
-	Bar bar;
-	bool desiredVisibility {true};
-	bool hasData;
-	uint32_t tags;
-};
+#include "monitor.hpp"
+#include "raster_cache.hpp"
+#include "render_worker.hpp"
+#include "scale.hpp"
+#include "status_blocks.hpp"
+#include "status_line.hpp"
+#include "status_protocol.hpp"
+#include "tokenizer.hpp"
 
 struct SeatPointer {
 	wl_unique_ptr<wl_pointer> wlPointer;
 	Monitor* focusedMonitor;
 	int x, y;
 	std::vector<int> btns;
+	// the cursor is set once its theme has loaded, with the serial of the enter
+	uint32_t enterSerial;
+	bool cursorPending;
+	// per wl_pointer axis: what the current frame scrolled, and what is left
+	// over from earlier frames until it adds up to a step
+	double axisValue[2];
+	int axisDiscrete[2];
+	bool axisHasDiscrete[2];
+	double axisRemainder[2];
 };
 struct Seat {
 	uint32_t name;
@@ -48,47 +63,73 @@ struct Seat {
 	std::optional<SeatPointer> pointer;
 };
 
-static Monitor* monitorFromSurface(const wl_surface* surface);
 static void setupMonitor(uint32_t name, wl_output* output);
 static void updatemon(Monitor &mon);
 static void onReady();
 static void setupStatusFifo();
+static void setupControlSocket(const std::string& path);
+static int sendCommand(const std::string& command);
 static void onStatus();
+static void requestBinaryStatus();
+static void startStdin();
 static void onStdin();
-static void handleStdin(const std::string& line);
-static void updateVisibility(const std::string& name, bool(*updater)(bool));
+static void handleStdin(std::string_view line);
+static void handleStatusRecord(const StatusRecord& rec);
+static void updateSelmon(Monitor& mon, bool selected);
+static void updateTags(Monitor& mon, uint32_t occupied, uint32_t tags, uint32_t clientTags, uint32_t urgent);
+static void updateStatus(std::string_view status);
+static std::string handleControl(ControlClient& client, std::string_view packet);
 static void onGlobalAdd(void*, wl_registry* registry, uint32_t name, const char* interface, uint32_t version);
 static void onGlobalRemove(void*, wl_registry* registry, uint32_t name);
 static void requireGlobal(const void* p, const char* name);
+static void onDisplay(uint32_t events);
+static void prepareWaylandRead();
+static void finishWaylandRead();
 static void waylandFlush();
 static void cleanup();
 
 wl_display* display;
 wl_compositor* compositor;
 wl_shm* shm;
+wl_subcompositor* subcompositor;
+wp_viewporter* viewporter;
+wp_fractional_scale_manager_v1* fractionalScaleManager;
 zwlr_layer_shell_v1* wlrLayerShell;
 static xdg_wm_base* xdgWmBase;
 static zxdg_output_manager_v1* xdgOutputManager;
-static wl_surface* cursorSurface;
-static wl_cursor_image* cursorImage;
+static std::optional<CursorCache> cursors;
 static bool ready;
-static std::list<Monitor> monitors;
+static MonitorRegistry monitors;
 static std::vector<std::pair<uint32_t, wl_output*>> uninitializedOutputs;
 static std::list<Seat> seats;
 static Monitor* selmon;
-static std::string lastStatus;
+static std::shared_ptr<const std::string> lastStatus {std::make_shared<const std::string>()};
+static uint64_t droppedStatusUpdates;
 static std::string statusFifoName;
-static std::vector<pollfd> pollfds;
-static std::array<int, 2> signalSelfPipe;
+static std::optional<ControlServer> controlServer;
+static EventLoop eventLoop;
+static std::optional<StatusBlocks> builtinStatus;
 static int displayFd {-1};
+static bool waylandReadPrepared {false};
+static bool waylandFlushPending {false};
 static int statusFifoFd {-1};
 static int statusFifoWriter {-1};
-static bool quitting {false};
+static bool binaryStatusRequested {false};
+static bool stdinIsBinary {false};
+static bool readingStdin {false};
+// monitors from startup that have no xdg_output name yet
+static int pendingXdgNames {0};
+static bool showTimeline {false};
+static timespec startTime;
 
 void spawn(Monitor&, const Arg& arg)
 {
 	if (fork() == 0) {
 		auto argv = static_cast<char* const*>(arg.v);
+		// the event loop blocks the signals it handles, don't pass that on
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigprocmask(SIG_SETMASK, &mask, nullptr);
 		setsid();
 		execvp(argv[0], argv);
 		fprintf(stderr, "somebar: execvp %s ", argv[0]);
@@ -109,38 +150,68 @@ static const struct zxdg_output_v1_listener xdgOutputListener = {
 	.done = [](void*, zxdg_output_v1*) { },
 	.name = [](void* mp, zxdg_output_v1* xdgOutput, const char* name) {
 		auto& monitor = *static_cast<Monitor*>(mp);
-		monitor.xdgName = name;
+		if (!readingStdin && monitor.xdgName.empty()) {
+			pendingXdgNames--;
+		}
+		monitors.setXdgName(monitor, name);
 		zxdg_output_v1_destroy(xdgOutput);
+		startStdin();
 	},
 	.description = [](void*, zxdg_output_v1*, const char*) { },
 };
 
-Monitor* monitorFromSurface(const wl_surface* surface)
+// returns false if the cursor for the scale of the focused monitor is still loading
+static bool setCursor(SeatPointer& pointer)
 {
-	auto mon = std::find_if(begin(monitors), end(monitors), [surface](const Monitor& mon) {
-		return mon.bar.surface() == surface;
-	});
-	return mon != end(monitors) ? &*mon : nullptr;
+	// cursor themes only come in whole sizes, so round a fractional scale up
+	auto mon = pointer.focusedMonitor;
+	auto scale = mon ? (mon->bar.scale() + scaleBase - 1) / scaleBase : 1;
+	auto cursor = cursors->get(scale);
+	if (!cursor) {
+		return false;
+	}
+	wl_pointer_set_cursor(pointer.wlPointer.get(), pointer.enterSerial, cursor->surface,
+		cursor->hotspotX, cursor->hotspotY);
+	return true;
+}
+
+static void onCursorLoaded()
+{
+	for (auto& seat : seats) {
+		if (seat.pointer && seat.pointer->cursorPending) {
+			seat.pointer->cursorPending = !setCursor(*seat.pointer);
+		}
+	}
 }
+
+// how many steps the current frame scrolled along an axis, negative for up or left
+static int scrollSteps(SeatPointer& pointer, int axis)
+{
+	// a wheel sends its notches along with the value, use those as they are
+	if (pointer.axisHasDiscrete[axis]) {
+		pointer.axisRemainder[axis] = 0;
+		return pointer.axisDiscrete[axis];
+	}
+	auto& remainder = pointer.axisRemainder[axis];
+	remainder += pointer.axisValue[axis];
+	auto steps = static_cast<int>(remainder / scrollStep);
+	remainder -= steps * scrollStep;
+	return steps;
+}
+
 static const struct wl_pointer_listener pointerListener = {
-	.enter = [](void* sp, wl_pointer* pointer, uint32_t serial,
+	.enter = [](void* sp, wl_pointer*, uint32_t serial,
 	wl_surface* surface, wl_fixed_t x, wl_fixed_t y)
 	{
 		auto& seat = *static_cast<Seat*>(sp);
-		seat.pointer->focusedMonitor = monitorFromSurface(surface);
-		if (!cursorImage) {
-			auto cursorTheme = wl_cursor_theme_load(nullptr, 24, shm);
-			cursorImage = wl_cursor_theme_get_cursor(cursorTheme, "left_ptr")->images[0];
-			cursorSurface = wl_compositor_create_surface(compositor);
-			wl_surface_attach(cursorSurface, wl_cursor_image_get_buffer(cursorImage), 0, 0);
-			wl_surface_commit(cursorSurface);
-		}
-		wl_pointer_set_cursor(pointer, serial, cursorSurface,
-			cursorImage->hotspot_x, cursorImage->hotspot_y);
+		seat.pointer->focusedMonitor = monitors.bySurface(surface);
+		seat.pointer->enterSerial = serial;
+		seat.pointer->cursorPending = !setCursor(*seat.pointer);
 	},
 	.leave = [](void* sp, wl_pointer*, uint32_t serial, wl_surface*) {
 		auto& seat = *static_cast<Seat*>(sp);
 		seat.pointer->focusedMonitor = nullptr;
+		seat.pointer->cursorPending = false;
 	},
 	.motion = [](void* sp, wl_pointer*, uint32_t, wl_fixed_t x, wl_fixed_t y) {
 		auto& seat = *static_cast<Seat*>(sp);
@@ -156,21 +227,51 @@ static const struct wl_pointer_listener pointerListener = {
 			seat.pointer->btns.erase(it);
 		}
 	},
-	.axis = [](void* sp, wl_pointer*, uint32_t, uint32_t, wl_fixed_t) { },
+	.axis = [](void* sp, wl_pointer*, uint32_t, uint32_t axis, wl_fixed_t value) {
+		auto& seat = *static_cast<Seat*>(sp);
+		if (axis <= WL_POINTER_AXIS_HORIZONTAL_SCROLL) {
+			seat.pointer->axisValue[axis] += wl_fixed_to_double(value);
+		}
+	},
 	.frame = [](void* sp, wl_pointer*) {
 		auto& seat = *static_cast<Seat*>(sp);
-		auto mon = seat.pointer->focusedMonitor;
-		if (!mon) {
-			return;
+		auto& pointer = *seat.pointer;
+		auto mon = pointer.focusedMonitor;
+		if (mon) {
+			for (auto btn : pointer.btns) {
+				mon->bar.click(mon, pointer.x, pointer.y, btn);
+			}
+			for (auto axis = 0; axis < 2; axis++) {
+				auto steps = scrollSteps(pointer, axis);
+				auto btn = axis == WL_POINTER_AXIS_VERTICAL_SCROLL
+					? (steps < 0 ? ScrollUp : ScrollDown)
+					: (steps < 0 ? ScrollLeft : ScrollRight);
+				for (auto i = 0; i < std::abs(steps); i++) {
+					mon->bar.click(mon, pointer.x, pointer.y, btn);
+				}
+			}
 		}
-		for (auto btn : seat.pointer->btns) {
-			mon->bar.click(mon, seat.pointer->x, seat.pointer->y, btn);
+		pointer.btns.clear();
+		for (auto axis = 0; axis < 2; axis++) {
+			pointer.axisValue[axis] = 0;
+			pointer.axisDiscrete[axis] = 0;
+			pointer.axisHasDiscrete[axis] = false;
 		}
-		seat.pointer->btns.clear();
 	},
 	.axis_source = [](void*, wl_pointer*, uint32_t) { },
-	.axis_stop = [](void*, wl_pointer*, uint32_t, uint32_t) { },
-	.axis_discrete = [](void*, wl_pointer*, uint32_t, int32_t) { },
+	.axis_stop = [](void* sp, wl_pointer*, uint32_t, uint32_t axis) {
+		auto& seat = *static_cast<Seat*>(sp);
+		if (axis <= WL_POINTER_AXIS_HORIZONTAL_SCROLL) {
+			seat.pointer->axisRemainder[axis] = 0;
+		}
+	},
+	.axis_discrete = [](void* sp, wl_pointer*, uint32_t axis, int32_t discrete) {
+		auto& seat = *static_cast<Seat*>(sp);
+		if (axis <= WL_POINTER_AXIS_HORIZONTAL_SCROLL) {
+			seat.pointer->axisDiscrete[axis] += discrete;
+			seat.pointer->axisHasDiscrete[axis] = true;
+		}
+	},
 };
 
 static const struct wl_seat_listener seatListener = {
@@ -189,11 +290,26 @@ static const struct wl_seat_listener seatListener = {
 	.name = [](void*, wl_seat*, const char* name) { }
 };
 
+static const struct wl_output_listener outputListener = {
+	.geometry = [](void*, wl_output*, int32_t, int32_t, int32_t, int32_t, int32_t, const char*, const char*, int32_t) { },
+	.mode = [](void*, wl_output*, uint32_t, int32_t, int32_t, int32_t) { },
+	.done = [](void*, wl_output*) { },
+	.scale = [](void* mv, wl_output*, int32_t factor) {
+		auto& mon = *static_cast<Monitor*>(mv);
+		mon.bar.setOutputScale(factor);
+		cursors->preload(factor);
+	},
+};
+
 void setupMonitor(uint32_t name, wl_output* output) {
-	auto& monitor = monitors.emplace_back(Monitor {name, {}, wl_unique_ptr<wl_output> {output}});
+	auto& monitor = monitors.add(name, output);
+	wl_output_add_listener(output, &outputListener, &monitor);
 	monitor.bar.setStatus(lastStatus);
 	auto xdgOutput = zxdg_output_manager_v1_get_xdg_output(xdgOutputManager, monitor.wlOutput.get());
 	zxdg_output_v1_add_listener(xdgOutput, &xdgOutputListener, &monitor);
+	if (!readingStdin) {
+		pendingXdgNames++;
+	}
 }
 
 void updatemon(Monitor& mon)
@@ -206,9 +322,11 @@ void updatemon(Monitor& mon)
 			mon.bar.invalidate();
 		} else {
 			mon.bar.show(mon.wlOutput.get());
+			monitors.updateSurface(mon);
 		}
 	} else if (mon.bar.visible()) {
 		mon.bar.hide();
+		monitors.updateSurface(mon);
 	}
 }
 
@@ -220,13 +338,15 @@ void onReady()
 	requireGlobal(wlrLayerShell, "zwlr_layer_shell_v1");
 	requireGlobal(xdgOutputManager, "zxdg_output_manager_v1");
 	setupStatusFifo();
-	wl_display_roundtrip(display); // roundtrip so we receive all dwl tags etc.
+	// the theme is read from disk while the monitors are set up
+	cursors.emplace(eventLoop, onCursorLoaded);
+	cursors->preload(1);
 
 	ready = true;
 	for (auto output : uninitializedOutputs) {
 		setupMonitor(output.first, output.second);
 	}
-	wl_display_roundtrip(display); // wait for xdg_output names before we read stdin
+	// the xdg_output names come in through the event loop, see startStdin()
 }
 
 bool createFifo(std::string path)
@@ -246,10 +366,8 @@ bool createFifo(std::string path)
 		}
 		statusFifoWriter = fd;
 
-		pollfds.push_back({
-			.fd = statusFifoFd,
-			.events = POLLIN,
-		});
+		eventLoop.add(statusFifoFd, EPOLLIN, [](uint32_t) { onStatus(); });
+		setupControlSocket(path + ".sock");
 		return true;
 	} else if (errno != EEXIST) {
 		diesys("mkfifo");
@@ -273,117 +391,383 @@ void setupStatusFifo()
 	}
 }
 
-static LineBuffer<512> stdinBuffer;
+// offers dwl to switch to binary status records, see status_protocol.hpp
+void requestBinaryStatus()
+{
+	auto replyFdStr = getenv("DWL_STATUS_REPLY_FD");
+	if (!replyFdStr) {
+		return;
+	}
+	auto formatsStr = getenv("DWL_STATUS_FORMATS");
+	auto formats = Tokenizer {formatsStr ? formatsStr : ""};
+	auto offered = false;
+	for (auto format = formats.word(); !format.empty(); format = formats.word()) {
+		offered |= format == statusBinaryOffer;
+	}
+	// never write to or close stdin, which is the status pipe, or stdout and stderr
+	auto replyFd = -1;
+	auto replyFdView = std::string_view {replyFdStr};
+	auto [end, ec] = std::from_chars(replyFdView.data(), replyFdView.data() + replyFdView.size(), replyFd);
+	if (ec == std::errc {} && end == replyFdView.data() + replyFdView.size() && replyFd > STDERR_FILENO) {
+		if (binaryStatus && offered) {
+			auto res = write(replyFd, statusBinaryReply.data(), statusBinaryReply.size());
+			binaryStatusRequested = res == static_cast<ssize_t>(statusBinaryReply.size());
+		}
+		close(replyFd);
+	}
+	// don't leak the offer to the processes we spawn
+	unsetenv("DWL_STATUS_REPLY_FD");
+	unsetenv("DWL_STATUS_FORMATS");
+}
+
+void setupControlSocket(const std::string& path)
+{
+	controlServer.emplace(handleControl,
+		[](int fd) { eventLoop.add(fd, EPOLLIN, [fd](uint32_t) { controlServer->dispatch(fd); }); },
+		[](int fd) { eventLoop.remove(fd); });
+	controlServer->listen(path);
+}
+
+// sends a command to a running somebar, preferring its control socket over the fifo.
+// returns the exit code for somebar -c.
+int sendCommand(const std::string& command)
+{
+	auto socketPath = statusFifoName + ".sock";
+	auto addr = sockaddr_un {};
+	addr.sun_family = AF_UNIX;
+	auto fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd >= 0 && socketPath.size() < sizeof(addr.sun_path)) {
+		std::copy(socketPath.begin(), socketPath.end(), addr.sun_path);
+		if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+			// die() would clean up the fifo of the running instance
+			auto timeout = timeval {5, 0};
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			auto reply = std::string {};
+			auto n = ssize_t {-1};
+			if (send(fd, command.data(), command.size(), MSG_NOSIGNAL) >= 0) {
+				// a reply may be larger than any command, so peek at its size first
+				n = recv(fd, nullptr, 0, MSG_PEEK | MSG_TRUNC);
+			}
+			if (n > 0) {
+				reply.resize(n);
+				n = recv(fd, reply.data(), reply.size(), 0);
+			}
+			if (n <= 0) {
+				perror("control socket");
+				return 1;
+			}
+			auto str = std::string_view {reply.data(), static_cast<size_t>(n)};
+			constexpr auto ok = std::string_view {"ok\n"};
+			if (str.size() >= ok.size() && str.substr(str.size() - ok.size()) == ok) {
+				fwrite(str.data(), 1, str.size() - ok.size(), stdout);
+				return 0;
+			}
+			fwrite(str.data(), 1, str.size(), stderr);
+			return 1;
+		}
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	// older somebar, or the socket could not be created
+	statusFifoWriter = open(statusFifoName.c_str(), O_WRONLY | O_CLOEXEC);
+	if (statusFifoWriter < 0) {
+		fprintf(stderr, "could not open %s: ", statusFifoName.c_str());
+		perror("");
+		return 1;
+	}
+	write(statusFifoWriter, command.c_str(), command.size());
+	return 0;
+}
+
+// dwl names monitors by their xdg_output name, so stdin is only read once the
+// monitors that were there at startup have theirs. Until then dwl just waits.
+void startStdin()
+{
+	if (readingStdin || pendingXdgNames > 0) {
+		return;
+	}
+	readingStdin = true;
+	timelineMark("monitor names received, reading status");
+	if (fcntl(STDIN_FILENO, F_SETFL, O_NONBLOCK) < 0) {
+		diesys("fcntl F_SETFL");
+	}
+	if (!eventLoop.add(STDIN_FILENO, EPOLLIN, [](uint32_t) { onStdin(); })) {
+		// epoll refuses regular files, which are always readable
+		onStdin();
+	}
+}
+
+static LineBuffer<512, 64*1024> stdinBuffer;
+static RecordBuffer stdinRecords;
 static void onStdin()
 {
-	auto res = stdinBuffer.readLines(
-		[](void* p, size_t size) { return read(0, p, size); },
-		[](char* p, size_t size) { handleStdin({p, size}); });
+	auto res = ssize_t {0};
+	if (!stdinIsBinary) {
+		res = stdinBuffer.readLines(
+			[](void* p, size_t size) { return read(0, p, size); },
+			[](const char* p, size_t size) {
+				auto line = std::string_view {p, size};
+				if (binaryStatusRequested && line == statusBinarySwitch) {
+					stdinIsBinary = true;
+					return false;
+				}
+				handleStdin(line);
+				return true;
+			});
+		if (stdinIsBinary) {
+			stdinRecords.append(stdinBuffer.takeBuffered());
+		}
+	}
+	if (stdinIsBinary) {
+		res = stdinRecords.readRecords(
+			[](void* p, size_t size) { return read(0, p, size); },
+			handleStatusRecord);
+		if (res < 0 && errno == EPROTO) {
+			die("reading status record");
+		}
+	}
 	if (res == 0) {
-		quitting = true;
+		eventLoop.quit();
 	}
 }
 
-static void handleStdin(const std::string& line)
+static void handleStdin(std::string_view line)
 {
-	// this parses the lines that dwl sends in printstatus()
-	std::string monName, command;
-	auto stream = std::istringstream {line};
-	stream >> monName >> command;
-	if (!stream.good()) {
+	auto parsed = parseStatusLine(line);
+	if (!parsed) {
 		return;
 	}
-	auto mon = std::find_if(begin(monitors), end(monitors), [&](const Monitor& mon) {
-		return mon.xdgName == monName;
-	});
-	if (mon == end(monitors))
+	auto mon = monitors.byXdgName(parsed->monitor);
+	if (!mon)
 		return;
-	if (command == "title") {
-		auto title = std::string {};
-		stream >> std::ws;
-		std::getline(stream, title);
-		mon->bar.setTitle(title);
-	} else if (command == "selmon") {
-		uint32_t selected;
-		stream >> selected;
-		mon->bar.setSelected(selected);
-		if (selected) {
-			selmon = &*mon;
-		} else if (selmon == &*mon) {
-			selmon = nullptr;
-		}
-	} else if (command == "tags") {
-		uint32_t occupied, tags, clientTags, urgent;
-		stream >> occupied >> tags >> clientTags >> urgent;
-		for (auto i=0u; i<tagNames.size(); i++) {
-			auto tagMask = 1 << i;
-			int state = TagState::None;
-			if (tags & tagMask)
-				state |= TagState::Active;
-			if (urgent & tagMask)
-				state |= TagState::Urgent;
-			mon->bar.setTag(i, state, occupied & tagMask ? 1 : 0, clientTags & tagMask ? 0 : -1);
-		}
-		mon->tags = tags;
-	} else if (command == "layout") {
-		auto layout = std::string {};
-		stream >> std::ws;
-		std::getline(stream, layout);
-		mon->bar.setLayout(layout);
+	switch (parsed->type) {
+	case StatusLineType::Title:
+		mon->bar.setTitle(parsed->text);
+		break;
+	case StatusLineType::Selmon:
+		updateSelmon(*mon, parsed->selected);
+		break;
+	case StatusLineType::Tags:
+		updateTags(*mon, parsed->occupied, parsed->tags, parsed->clientTags, parsed->urgent);
+		break;
+	case StatusLineType::Layout:
+		mon->bar.setLayout(parsed->text);
+		break;
+	case StatusLineType::Other:
+		break;
 	}
 	mon->hasData = true;
 	updatemon(*mon);
 }
 
-const std::string prefixStatus = "status ";
-const std::string prefixShow = "show ";
-const std::string prefixHide = "hide ";
-const std::string prefixToggle = "toggle ";
-const std::string argAll = "all";
-const std::string argSelected = "selected";
+static void handleStatusRecord(const StatusRecord& rec)
+{
+	if (rec.kind != StatusRecordMonitor) {
+		return;
+	}
+	auto mon = monitors.byXdgName(rec.name);
+	if (!mon) {
+		return;
+	}
+	mon->bar.setTitle(rec.title);
+	updateSelmon(*mon, rec.flags & StatusSelected);
+	updateTags(*mon, rec.occupied, rec.tags, rec.clientTags, rec.urgent);
+	mon->bar.setLayout(rec.layout);
+	mon->hasData = true;
+	updatemon(*mon);
+}
+
+void updateSelmon(Monitor& mon, bool selected)
+{
+	mon.bar.setSelected(selected);
+	if (selected) {
+		selmon = &mon;
+	} else if (selmon == &mon) {
+		selmon = nullptr;
+	}
+}
+
+void updateTags(Monitor& mon, uint32_t occupied, uint32_t tags, uint32_t clientTags, uint32_t urgent)
+{
+	for (auto i=0u; i<tagNames.size(); i++) {
+		auto tagMask = 1 << i;
+		int state = TagState::None;
+		if (tags & tagMask)
+			state |= TagState::Active;
+		if (urgent & tagMask)
+			state |= TagState::Urgent;
+		mon.bar.setTag(i, state, occupied & tagMask ? 1 : 0, clientTags & tagMask ? 0 : -1);
+	}
+	mon.tags = tags;
+}
+
+// commands that arrive together are applied in one pass: only the last status
+// is laid out, and every monitor is updated at most once
+class CommandBatch {
+	std::optional<std::string> _status;
+	std::vector<Monitor*> _touched;
+
+	void updateVisibility(std::string_view name, bool(*updater)(bool));
+	void updateVisibility(Monitor& mon, bool(*updater)(bool));
+public:
+	void add(const Command& cmd);
+	void apply();
+};
 
-static LineBuffer<512> statusBuffer;
+static LineBuffer<512, 64*1024> statusBuffer;
 void onStatus()
 {
+	auto batch = CommandBatch {};
 	statusBuffer.readLines(
 	[](void* p, size_t size) {
 		return read(statusFifoFd, p, size);
 	},
-	[](const char* buffer, size_t n) {
-		auto str = std::string {buffer, n};
-		if (str.rfind(prefixStatus, 0) == 0) {
-			lastStatus = str.substr(prefixStatus.size());
-			for (auto &monitor : monitors) {
-				monitor.bar.setStatus(lastStatus);
-				monitor.bar.invalidate();
-			}
-		} else if (str.rfind(prefixShow, 0) == 0) {
-			updateVisibility(str.substr(prefixShow.size()), [](bool) { return true; });
-		} else if (str.rfind(prefixHide, 0) == 0) {
-			updateVisibility(str.substr(prefixHide.size()), [](bool) { return false; });
-		} else if (str.rfind(prefixToggle, 0) == 0) {
-			updateVisibility(str.substr(prefixToggle.size()), [](bool vis) { return !vis; });
+	[&](const char* buffer, size_t n) {
+		if (auto cmd = parseCommand({buffer, n})) {
+			batch.add(*cmd);
 		}
 	});
+	batch.apply();
 }
 
-void updateVisibility(const std::string& name, bool(*updater)(bool))
+void CommandBatch::add(const Command& cmd)
 {
-	auto isCurrent = name == argSelected;
-	auto isAll = name == argAll;
-	for (auto& mon : monitors) {
-		if (isAll ||
-			isCurrent && &mon == selmon ||
-			mon.xdgName == name) {
-			auto newVisibility = updater(mon.desiredVisibility);
-			if (newVisibility != mon.desiredVisibility) {
-				mon.desiredVisibility = newVisibility;
-				updatemon(mon);
-			}
+	switch (cmd.type) {
+	case CommandType::Status:
+		_status = cmd.arg;
+		break;
+	case CommandType::Show:
+		updateVisibility(cmd.arg, [](bool) { return true; });
+		break;
+	case CommandType::Hide:
+		updateVisibility(cmd.arg, [](bool) { return false; });
+		break;
+	case CommandType::Toggle:
+		updateVisibility(cmd.arg, [](bool vis) { return !vis; });
+		break;
+	}
+}
+
+void CommandBatch::apply()
+{
+	if (_status) {
+		updateStatus(*_status);
+	}
+	for (auto mon : _touched) {
+		updatemon(*mon);
+	}
+	_status.reset();
+	_touched.clear();
+}
+
+void CommandBatch::updateVisibility(Monitor& mon, bool(*updater)(bool))
+{
+	mon.desiredVisibility = updater(mon.desiredVisibility);
+	if (std::find(_touched.begin(), _touched.end(), &mon) == _touched.end()) {
+		_touched.push_back(&mon);
+	}
+}
+
+void CommandBatch::updateVisibility(std::string_view name, bool(*updater)(bool))
+{
+	if (name == argAll) {
+		for (auto& mon : monitors) {
+			updateVisibility(mon, updater);
+		}
+	} else if (auto mon = name == argSelected ? selmon : monitors.byXdgName(name)) {
+		updateVisibility(*mon, updater);
+	}
+}
+
+void updateStatus(std::string_view status)
+{
+	lastStatus = std::make_shared<const std::string>(status);
+	auto dropped = false;
+	for (auto &monitor : monitors) {
+		if (coalesceStatus) {
+			dropped |= monitor.bar.queueStatus(lastStatus);
+		} else {
+			monitor.bar.setStatus(lastStatus);
+			monitor.bar.invalidate();
+		}
+	}
+	if (dropped) {
+		droppedStatusUpdates++;
+	}
+	if (controlServer) {
+		controlServer->broadcast("status " + *lastStatus + "\n");
+	}
+}
+
+static void handleQuery(ControlClient& client, Query query, std::string& reply)
+{
+	switch (query) {
+	case Query::Monitors:
+		for (auto& mon : monitors) {
+			reply += mon.xdgName;
+			reply += mon.bar.visible() ? " visible" : " hidden";
+			reply += &mon == selmon ? " selected\n" : "\n";
 		}
+		break;
+	case Query::Status:
+		reply += *lastStatus;
+		reply += "\n";
+		break;
+	case Query::Stats:
+		reply += "droppedStatusUpdates " + std::to_string(droppedStatusUpdates) + "\n";
+		reply += "rasterCacheHits " + std::to_string(rasterCache.hits()) + "\n";
+		reply += "rasterCacheMisses " + std::to_string(rasterCache.misses()) + "\n";
+		reply += "rasterCacheBytes " + std::to_string(rasterCache.bytes()) + "\n";
+		reply += "bufferWaits " + std::to_string(shmBufferStats.waits) + "\n";
+		reply += "bufferAllocations " + std::to_string(shmBufferStats.allocations) + "\n";
+		reply += "bufferPoolGrows " + std::to_string(shmBufferStats.poolGrows) + "\n";
+		break;
+	case Query::Subscribe:
+		client.subscribed = true;
+		break;
+	case Query::Unsubscribe:
+		client.subscribed = false;
+		break;
 	}
 }
 
+// every packet is a batch of commands and queries, one per line. The commands
+// are applied together first, then the queries are answered in order. The
+// reply ends with "ok" or with an error line, in which case nothing was applied.
+std::string handleControl(ControlClient& client, std::string_view packet)
+{
+	auto commands = std::vector<Command> {};
+	auto queries = std::vector<Query> {};
+	while (!packet.empty()) {
+		auto end = std::min(packet.find('\n'), packet.size());
+		auto line = packet.substr(0, end);
+		packet.remove_prefix(std::min(end + 1, packet.size()));
+		if (line.empty()) {
+			continue;
+		}
+		if (auto cmd = parseCommand(line)) {
+			commands.push_back(*cmd);
+		} else if (auto query = parseQuery(line)) {
+			queries.push_back(*query);
+		} else {
+			return "error: unknown command: " + std::string {line} + "\n";
+		}
+	}
+	auto batch = CommandBatch {};
+	for (const auto& cmd : commands) {
+		batch.add(cmd);
+	}
+	batch.apply();
+	auto reply = std::string {};
+	for (auto query : queries) {
+		handleQuery(client, query, reply);
+	}
+	reply += "ok\n";
+	return reply;
+}
+
 struct HandleGlobalHelper {
 	wl_registry* registry;
 	uint32_t name;
@@ -403,6 +787,9 @@ void onGlobalAdd(void*, wl_registry* registry, uint32_t name, const char* interf
 	auto reg = HandleGlobalHelper { registry, name, interface };
 	if (reg.handle(compositor, wl_compositor_interface, 4)) return;
 	if (reg.handle(shm, wl_shm_interface, 1)) return;
+	if (reg.handle(subcompositor, wl_subcompositor_interface, 1)) return;
+	if (reg.handle(viewporter, wp_viewporter_interface, 1)) return;
+	if (reg.handle(fractionalScaleManager, wp_fractional_scale_manager_v1_interface, 1)) return;
 	if (reg.handle(wlrLayerShell, zwlr_layer_shell_v1_interface, 4)) return;
 	if (reg.handle(xdgOutputManager, zxdg_output_manager_v1_interface, 3)) return;
 	if (reg.handle(xdgWmBase, xdg_wm_base_interface, 2)) {
@@ -414,7 +801,8 @@ void onGlobalAdd(void*, wl_registry* registry, uint32_t name, const char* interf
 		wl_seat_add_listener(wlSeat, &seatListener, &seat);
 		return;
 	}
-	if (wl_output* output; reg.handle(output, wl_output_interface, 1)) {
+	// version 2 for the scale
+	if (wl_output* output; reg.handle(output, wl_output_interface, std::min(version, 2u))) {
 		if (ready) {
 			setupMonitor(name, output);
 		} else {
@@ -425,7 +813,21 @@ void onGlobalAdd(void*, wl_registry* registry, uint32_t name, const char* interf
 }
 void onGlobalRemove(void*, wl_registry* registry, uint32_t name)
 {
-	monitors.remove_if([name](const Monitor &mon) { return mon.registryName == name; });
+	if (auto mon = monitors.byRegistryName(name)) {
+		if (!readingStdin && mon->xdgName.empty()) {
+			pendingXdgNames--;
+			startStdin();
+		}
+		if (selmon == mon) {
+			selmon = nullptr;
+		}
+		for (auto& seat : seats) {
+			if (seat.pointer && seat.pointer->focusedMonitor == mon) {
+				seat.pointer->focusedMonitor = nullptr;
+			}
+		}
+		monitors.remove(name);
+	}
 	seats.remove_if([name](const Seat &seat) { return seat.name == name; });
 }
 static const struct wl_registry_listener registry_listener = {
@@ -435,16 +837,21 @@ static const struct wl_registry_listener registry_listener = {
 
 int main(int argc, char* argv[])
 {
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
 	int opt;
-	while ((opt = getopt(argc, argv, "chvs:")) != -1) {
+	while ((opt = getopt(argc, argv, "chvTs:")) != -1) {
 		switch (opt) {
 			case 's':
 				statusFifoName = optarg;
 				break;
+			case 'T':
+				showTimeline = true;
+				break;
 			case 'h':
-				printf("Usage: %s [-h] [-v] [-s path to the fifo] [-c command]\n", argv[0]);
+				printf("Usage: %s [-h] [-v] [-T] [-s path to the fifo] [-c command]\n", argv[0]);
 				printf("  -h: Show this help\n");
 				printf("  -v: Show somebar version\n");
+				printf("  -T: Print a timeline of the startup to stderr\n");
 				printf("  -s: Change path to the fifo (default is \"$XDG_RUNTIME_DIR/somebar-0\")\n");
 				printf("  -c: Sends a command to sombar. See README for details.\n");
 				printf("If any of these are specified (except -s), somebar exits after the action.\n");
@@ -460,41 +867,20 @@ int main(int argc, char* argv[])
 				if (statusFifoName.empty()) {
 					statusFifoName = std::string {getenv("XDG_RUNTIME_DIR")} + "/somebar-0";
 				}
-				statusFifoWriter = open(statusFifoName.c_str(), O_WRONLY | O_CLOEXEC);
-				if (statusFifoWriter < 0) {
-					fprintf(stderr, "could not open %s: ", statusFifoName.c_str());
-					perror("");
-					exit(1);
-				}
 				auto str = std::string {};
 				for (auto i = optind; i<argc; i++) {
 					if (i > optind) str += " ";
 					str += argv[i];
 				}
 				str += "\n";
-				write(statusFifoWriter, str.c_str(), str.size());
-				exit(0);
+				exit(sendCommand(str));
 		}
 	}
 	
-	if (pipe(signalSelfPipe.data()) < 0) {
-		diesys("pipe");
-	}
-	setCloexec(signalSelfPipe[0]);
-	setCloexec(signalSelfPipe[1]);
-
-	struct sigaction sighandler = {};
-	sighandler.sa_handler = [](int) {
-		if (write(signalSelfPipe[1], "0", 1) < 0) {
-			diesys("write");
-		}
-	};
-	if (sigaction(SIGTERM, &sighandler, nullptr) < 0) {
-		diesys("sigaction");
-	}
-	if (sigaction(SIGINT, &sighandler, nullptr) < 0) {
-		diesys("sigaction");
-	}
+	// threads inherit the signal mask, so block the signals before starting any
+	eventLoop.addSignals({SIGTERM, SIGINT}, [](int) { eventLoop.quit(); });
+	// overlaps with connecting to the compositor and the registry roundtrip
+	loadFont();
 
 	struct sigaction chld_handler = {};
 	chld_handler.sa_handler = SIG_IGN;
@@ -502,64 +888,37 @@ int main(int argc, char* argv[])
 		die("sigaction");
 	}
 
-	pollfds.push_back({
-		.fd = signalSelfPipe[0],
-		.events = POLLIN,
-	});
-
 	display = wl_display_connect(nullptr);
 	if (!display) {
 		die("Failed to connect to Wayland display");
 	}
 	displayFd = wl_display_get_fd(display);
+	timelineMark("connected to the display");
+	if (renderThread) {
+		renderWorker = new RenderWorker {eventLoop};
+	}
+	requestBinaryStatus();
 
 	auto registry = wl_display_get_registry(display);
 	wl_registry_add_listener(registry, &registry_listener, nullptr);
 	wl_display_roundtrip(display);
+	timelineMark("globals received");
 	onReady();
 
-	pollfds.push_back({
-		.fd = displayFd,
-		.events = POLLIN,
-	});
-	pollfds.push_back({
-		.fd = STDIN_FILENO,
-		.events = POLLIN,
-	});
-	if (fcntl(STDIN_FILENO, F_SETFL, O_NONBLOCK) < 0) {
-		diesys("fcntl F_SETFL");
+	if (!statusBlocks.empty()) {
+		builtinStatus.emplace(eventLoop, statusBlocks, statusBlockSeparator, updateStatus);
+		builtinStatus->start();
 	}
 
-	while (!quitting) {
-		waylandFlush();
-		if (poll(pollfds.data(), pollfds.size(), -1) < 0) {
-			if (errno != EINTR) {
-				diesys("poll");
-			}
-		} else {
-			for (auto& ev : pollfds) {
-				if (ev.revents & POLLNVAL) {
-					die("poll revents contains POLLNVAL");
-				} else if (ev.fd == displayFd) {
-					if (ev.revents & POLLIN) {
-						if (wl_display_dispatch(display) < 0) {
-							die("wl_display_dispatch");
-						}
-					}
-					if (ev.revents & POLLOUT) {
-						ev.events = POLLIN;
-						waylandFlush();
-					}
-				} else if (ev.fd == STDIN_FILENO && (ev.revents & POLLIN)) {
-					onStdin();
-				} else if (ev.fd == statusFifoFd && (ev.revents & POLLIN)) {
-					onStatus();
-				} else if (ev.fd == signalSelfPipe[0] && (ev.revents & POLLIN)) {
-					quitting = true;
-				}
-			}
-		}
-	}
+	eventLoop.add(displayFd, EPOLLIN, onDisplay);
+	// if there are no monitors, there are no names to wait for
+	startStdin();
+
+	eventLoop.setHooks(prepareWaylandRead, finishWaylandRead);
+	eventLoop.run();
+	delete renderWorker;
+	renderWorker = nullptr;
+	cursors.reset();
 	cleanup();
 }
 
@@ -571,16 +930,68 @@ void requireGlobal(const void* p, const char* name)
 	exit(1);
 }
 
-void waylandFlush()
+// runs before the event loop waits. Once the read is prepared, no other code
+// reads events from the socket behind our back, so the wait cannot miss any.
+// Until finishWaylandRead(), nothing may dispatch or roundtrip the display.
+void prepareWaylandRead()
 {
-	wl_display_dispatch_pending(display);
-	if (wl_display_flush(display) < 0 && errno == EAGAIN) {
-		for (auto& ev : pollfds) {
-			if (ev.fd == displayFd) {
-				ev.events |= POLLOUT;
-			}
+	while (wl_display_prepare_read(display) != 0) {
+		if (wl_display_dispatch_pending(display) < 0) {
+			die("wl_display_dispatch_pending");
 		}
 	}
+	waylandReadPrepared = true;
+	waylandFlush();
+}
+
+void onDisplay(uint32_t events)
+{
+	if (events & EPOLLOUT) {
+		waylandFlush();
+	}
+	if (events & (EPOLLIN | EPOLLERR | EPOLLHUP) && waylandReadPrepared) {
+		waylandReadPrepared = false;
+		if (wl_display_read_events(display) < 0) {
+			die("wl_display_read_events");
+		}
+	}
+}
+
+// runs after the event loop dispatched the callbacks of a wakeup
+void finishWaylandRead()
+{
+	if (waylandReadPrepared) {
+		waylandReadPrepared = false;
+		wl_display_cancel_read(display);
+	}
+	if (wl_display_dispatch_pending(display) < 0) {
+		die("wl_display_dispatch_pending");
+	}
+}
+
+void waylandFlush()
+{
+	auto res = wl_display_flush(display);
+	if (res < 0 && errno == EAGAIN && !waylandFlushPending) {
+		// the socket is full, flush again once it is writable
+		waylandFlushPending = true;
+		eventLoop.modify(displayFd, EPOLLIN | EPOLLOUT);
+	} else if (res >= 0 && waylandFlushPending) {
+		waylandFlushPending = false;
+		eventLoop.modify(displayFd, EPOLLIN);
+	}
+}
+
+void timelineMark(const char* what)
+{
+	if (!showTimeline) {
+		return;
+	}
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	auto ms = (now.tv_sec - startTime.tv_sec) * 1e3 + (now.tv_nsec - startTime.tv_nsec) / 1e6;
+	// a single fprintf, as the font loader reports from its own thread
+	fprintf(stderr, "somebar: %8.2f ms  %s\n", ms, what);
 }
 
 void setCloexec(int fd)
@@ -598,6 +1009,9 @@ void cleanup() {
 	if (!statusFifoName.empty()) {
 		unlink(statusFifoName.c_str());
 	}
+	if (controlServer) {
+		controlServer->unlink();
+	}
 }
 
 void die(const char* why) {
@@ -0,0 +1,83 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <iterator>
+#include "monitor.hpp"
+
+Monitor& MonitorRegistry::add(uint32_t registryName, wl_output* output)
+{
+	// constructed in place, the bar registers its own address with wayland and the shm pool
+	auto& mon = _monitors.emplace_back();
+	mon.registryName = registryName;
+	mon.wlOutput.reset(output);
+	_byRegistryName[registryName] = std::prev(_monitors.end());
+	return mon;
+}
+
+bool MonitorRegistry::remove(uint32_t registryName)
+{
+	auto entry = _byRegistryName.find(registryName);
+	if (entry == _byRegistryName.end()) {
+		return false;
+	}
+	auto it = entry->second;
+	auto name = _byXdgName.find(it->xdgName);
+	if (name != _byXdgName.end() && name->second == &*it) {
+		_byXdgName.erase(name);
+	}
+	unindexSurface(*it);
+	_byRegistryName.erase(entry);
+	_monitors.erase(it);
+	return true;
+}
+
+void MonitorRegistry::setXdgName(Monitor& mon, std::string_view name)
+{
+	auto old = _byXdgName.find(mon.xdgName);
+	if (old != _byXdgName.end() && old->second == &mon) {
+		_byXdgName.erase(old);
+	}
+	mon.xdgName = name;
+	// another monitor may still hold the name, e.g. when an output is replugged
+	// before the old one is removed. Its key points into that monitor's xdgName,
+	// so the entry is replaced instead of assigned to.
+	_byXdgName.erase(mon.xdgName);
+	_byXdgName.emplace(mon.xdgName, &mon);
+}
+
+void MonitorRegistry::updateSurface(Monitor& mon)
+{
+	unindexSurface(mon);
+	if (auto surface = mon.bar.surface()) {
+		_bySurface[surface] = &mon;
+	}
+}
+
+void MonitorRegistry::unindexSurface(const Monitor& mon)
+{
+	// a monitor has at most one surface, and there are only a handful of monitors
+	for (auto it = _bySurface.begin(); it != _bySurface.end(); ++it) {
+		if (it->second == &mon) {
+			_bySurface.erase(it);
+			return;
+		}
+	}
+}
+
+Monitor* MonitorRegistry::byRegistryName(uint32_t registryName) const
+{
+	auto it = _byRegistryName.find(registryName);
+	return it != _byRegistryName.end() ? &*it->second : nullptr;
+}
+
+Monitor* MonitorRegistry::byXdgName(std::string_view name) const
+{
+	auto it = _byXdgName.find(name);
+	return it != _byXdgName.end() ? it->second : nullptr;
+}
+
+Monitor* MonitorRegistry::bySurface(const wl_surface* surface) const
+{
+	auto it = _bySurface.find(surface);
+	return it != _bySurface.end() ? it->second : nullptr;
+}
@@ -0,0 +1,50 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <wayland-client.h>
+#include "common.hpp"
+#include "bar.hpp"
+
+struct Monitor {
+	uint32_t registryName;
+	std::string xdgName;
+	wl_unique_ptr<wl_output> wlOutput;
+	Bar bar;
+	bool desiredVisibility {true};
+	bool hasData;
+	uint32_t tags;
+};
+
+// owns all monitors and indexes them by registry name, xdg name and bar surface.
+// monitors are kept in a list, so their addresses stay stable until they are removed.
+class MonitorRegistry {
+	std::list<Monitor> _monitors;
+	std::unordered_map<uint32_t, std::list<Monitor>::iterator> _byRegistryName;
+	// the keys point into Monitor::xdgName
+	std::unordered_map<std::string_view, Monitor*> _byXdgName;
+	std::unordered_map<const wl_surface*, Monitor*> _bySurface;
+
+	void unindexSurface(const Monitor& mon);
+public:
+	using iterator = std::list<Monitor>::iterator;
+
+	Monitor& add(uint32_t registryName, wl_output* output);
+	// returns false if there is no monitor with that registry name
+	bool remove(uint32_t registryName);
+	void setXdgName(Monitor& mon, std::string_view name);
+	// must be called whenever the bar's surface was created or destroyed
+	void updateSurface(Monitor& mon);
+
+	Monitor* byRegistryName(uint32_t registryName) const;
+	Monitor* byXdgName(std::string_view name) const;
+	Monitor* bySurface(const wl_surface* surface) const;
+
+	iterator begin() { return _monitors.begin(); }
+	iterator end() { return _monitors.end(); }
+	size_t size() const { return _monitors.size(); }
+};
@@ -0,0 +1,77 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <cstring>
+#include <pango/pangocairo.h>
+#include "config.hpp"
+#include "raster_cache.hpp"
+#include "scale.hpp"
+
+RasterCache rasterCache {rasterCacheSize};
+
+RasterCache::RasterCache(size_t maxBytes)
+	: _maxBytes {maxBytes}
+{
+}
+
+static void appendBytes(std::string& out, const void* data, size_t size)
+{
+	out.append(static_cast<const char*>(data), size);
+}
+
+cairo_surface_t* RasterCache::get(const SharedLayout& layout, const ColorScheme& scheme, int scale, int height)
+{
+	// fixed-size fields first, so no two keys can be confused
+	_scratchKey.clear();
+	appendBytes(_scratchKey, &scheme.fg, sizeof(scheme.fg));
+	appendBytes(_scratchKey, &scheme.bg, sizeof(scheme.bg));
+	appendBytes(_scratchKey, &scale, sizeof(scale));
+	appendBytes(_scratchKey, &height, sizeof(height));
+	appendBytes(_scratchKey, &layout.maxWidth, sizeof(layout.maxWidth));
+	_scratchKey.append(font);
+	_scratchKey.push_back('\0');
+	_scratchKey.append(layout.text);
+
+	auto it = _byKey.find(_scratchKey);
+	if (it != _byKey.end()) {
+		_hits++;
+		_entries.splice(_entries.begin(), _entries, it->second);
+		return it->second->surface.get();
+	}
+	_misses++;
+
+	// the layout was shaped at this scale already, so everything is in buffer pixels
+	auto padX = toBuffer(paddingX, scale);
+	auto padY = toBuffer(paddingY, scale);
+	auto width = layout.width() + padX*2;
+	auto surface = wl_unique_ptr<cairo_surface_t> {
+		cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height)};
+	auto painter = wl_unique_ptr<cairo_t> {cairo_create(surface.get())};
+	cairo_set_source_rgba(painter.get(),
+		scheme.bg.r/255.0, scheme.bg.g/255.0, scheme.bg.b/255.0, scheme.bg.a/255.0);
+	cairo_paint(painter.get());
+	cairo_set_source_rgba(painter.get(),
+		scheme.fg.r/255.0, scheme.fg.g/255.0, scheme.fg.b/255.0, scheme.fg.a/255.0);
+	cairo_move_to(painter.get(), padX, padY);
+	layout.draw(painter.get());
+	painter.reset();
+	cairo_surface_flush(surface.get());
+
+	auto bytes = static_cast<size_t>(cairo_image_surface_get_stride(surface.get())) * height;
+	_entries.push_front(Entry {_scratchKey, std::move(surface), bytes});
+	_byKey.emplace(_entries.front().key, _entries.begin());
+	_bytes += bytes;
+	evict();
+	return _entries.front().surface.get();
+}
+
+void RasterCache::evict()
+{
+	// never evict the entry that was just added, even if it alone is too large
+	while (_bytes > _maxBytes && _entries.size() > 1) {
+		auto& entry = _entries.back();
+		_bytes -= entry.bytes;
+		_byKey.erase(entry.key);
+		_entries.pop_back();
+	}
+}
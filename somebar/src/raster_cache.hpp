@@ -0,0 +1,51 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "common.hpp"
+#include "layout_store.hpp"
+
+// keeps components rasterized on their background, so drawing a component
+// that did not change is a blit instead of a pango layout and glyph render.
+// Entries are keyed by (text, width limit, font, color scheme, scale), and the least
+// recently used ones are evicted once they take up more than maxBytes.
+class RasterCache {
+	struct Entry {
+		std::string key;
+		wl_unique_ptr<cairo_surface_t> surface;
+		size_t bytes;
+	};
+	size_t _maxBytes;
+	// the counters are read by the main thread while the render thread works
+	std::atomic<size_t> _bytes {0};
+	// front is the most recently used entry
+	std::list<Entry> _entries;
+	std::unordered_map<std::string_view, std::list<Entry>::iterator> _byKey;
+	// reused by every lookup, so a hit does not allocate
+	std::string _scratchKey;
+	std::atomic<uint64_t> _hits {0}, _misses {0};
+
+	void evict();
+public:
+	explicit RasterCache(size_t maxBytes);
+	RasterCache(const RasterCache&) = delete;
+	RasterCache& operator=(const RasterCache&) = delete;
+
+	// returns layout drawn at paddingX/paddingY on a scheme.bg rectangle of
+	// the layout's width plus padding and the given height. layout must have
+	// been shaped at scale (in 120ths), and height and the result are in buffer
+	// pixels. The surface stays valid until the next call.
+	cairo_surface_t* get(const SharedLayout& layout, const ColorScheme& scheme, int scale, int height);
+
+	size_t bytes() const { return _bytes; }
+	uint64_t hits() const { return _hits; }
+	uint64_t misses() const { return _misses; }
+};
+
+extern RasterCache rasterCache;
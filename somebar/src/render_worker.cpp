@@ -0,0 +1,112 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <algorithm>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "bar.hpp"
+#include "render_worker.hpp"
+
+RenderWorker* renderWorker;
+
+RenderWorker::RenderWorker(EventLoop& loop)
+	: _loop {loop}
+{
+	_eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (_eventFd < 0) {
+		diesys("eventfd");
+	}
+	_loop.add(_eventFd, EPOLLIN, [this](uint32_t) { deliver(); });
+	_thread = std::thread {[this]() { run(); }};
+}
+
+RenderWorker::~RenderWorker()
+{
+	{
+		auto lock = std::unique_lock {_mutex};
+		_stopping = true;
+	}
+	_wake.notify_one();
+	_thread.join();
+	_loop.remove(_eventFd);
+	close(_eventFd);
+}
+
+void RenderWorker::post(Bar* owner, BarRenderer* renderer, BarSnapshot snapshot, std::vector<ShmBuffer::Buffer*> buffers)
+{
+	{
+		auto lock = std::unique_lock {_mutex};
+		_jobs.push_back(Job {owner, renderer, std::move(snapshot), std::move(buffers)});
+	}
+	_wake.notify_one();
+}
+
+void RenderWorker::cancel(Bar* owner)
+{
+	auto lock = std::unique_lock {_mutex};
+	_idle.wait(lock, [&]() { return _running != owner; });
+	_jobs.erase(std::remove_if(_jobs.begin(), _jobs.end(),
+		[&](const Job& job) { return job.owner == owner; }), _jobs.end());
+	_done.erase(std::remove_if(_done.begin(), _done.end(),
+		[&](const Done& done) { return done.owner == owner; }), _done.end());
+}
+
+void RenderWorker::retire(std::unique_ptr<BarRenderer> renderer)
+{
+	{
+		auto lock = std::unique_lock {_mutex};
+		_retired.push_back(std::move(renderer));
+	}
+	_wake.notify_one();
+}
+
+void RenderWorker::run()
+{
+	auto lock = std::unique_lock {_mutex};
+	while (true) {
+		_wake.wait(lock, [&]() { return _stopping || !_jobs.empty() || !_retired.empty(); });
+		if (_stopping) {
+			break;
+		}
+		if (!_retired.empty()) {
+			auto retired = std::move(_retired);
+			lock.unlock();
+			retired.clear();
+			lock.lock();
+			continue;
+		}
+		auto job = std::move(_jobs.front());
+		_jobs.pop_front();
+		_running = job.owner;
+		lock.unlock();
+
+		auto result = job.renderer->render(job.snapshot, job.buffers);
+
+		lock.lock();
+		_running = nullptr;
+		_done.push_back(Done {job.owner, std::move(result)});
+		_idle.notify_all();
+		// only fails if the counter overflows, and then the main thread is due to wake up anyway
+		uint64_t one = 1;
+		[[maybe_unused]] auto res = write(_eventFd, &one, sizeof(one));
+	}
+	// whatever is left is destroyed here, still on the render thread
+	_retired.clear();
+}
+
+// runs on the main thread when the eventfd fires
+void RenderWorker::deliver()
+{
+	uint64_t count;
+	if (read(_eventFd, &count, sizeof(count)) < 0) {
+		return;
+	}
+	auto done = std::vector<Done> {};
+	{
+		auto lock = std::unique_lock {_mutex};
+		done.swap(_done);
+	}
+	for (auto& d : done) {
+		d.owner->renderDone(std::move(d.result));
+	}
+}
@@ -0,0 +1,60 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bar_renderer.hpp"
+#include "event_loop.hpp"
+
+class Bar;
+
+// renders bar snapshots on a thread of its own, so shaping a long title does
+// not hold up the wayland connection. Results are handed back to the main
+// thread through an eventfd in the event loop.
+//
+// every bar has at most one snapshot in flight, and results are delivered in
+// order, so a stale frame cannot replace a newer one.
+class RenderWorker {
+	struct Job {
+		Bar* owner;
+		BarRenderer* renderer;
+		BarSnapshot snapshot;
+		std::vector<ShmBuffer::Buffer*> buffers;
+	};
+	struct Done {
+		Bar* owner;
+		RenderResult result;
+	};
+	EventLoop& _loop;
+	int _eventFd {-1};
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _wake, _idle;
+	std::deque<Job> _jobs;
+	std::vector<Done> _done;
+	std::vector<std::unique_ptr<BarRenderer>> _retired;
+	Bar* _running {nullptr};
+	bool _stopping {false};
+
+	void run();
+	void deliver();
+public:
+	explicit RenderWorker(EventLoop& loop);
+	RenderWorker(const RenderWorker&) = delete;
+	RenderWorker& operator=(const RenderWorker&) = delete;
+	~RenderWorker();
+
+	void post(Bar* owner, BarRenderer* renderer, BarSnapshot snapshot, std::vector<ShmBuffer::Buffer*> buffers);
+	// forgets owner's snapshot, waiting for it if it is being rendered right now
+	void cancel(Bar* owner);
+	// destroys renderer on the render thread
+	void retire(std::unique_ptr<BarRenderer> renderer);
+};
+
+// nullptr unless renderThread is set in config.hpp
+extern RenderWorker* renderWorker;
@@ -0,0 +1,14 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+
+// output scales are kept in 120ths, the unit wp_fractional_scale_v1 uses.
+// An integer scale of 2 is 240.
+constexpr int scaleBase = 120;
+
+// converts a length in surface coordinates to buffer pixels
+constexpr int toBuffer(int logical, int scale)
+{
+	return (logical * scale + scaleBase/2) / scaleBase;
+}
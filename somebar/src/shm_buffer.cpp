@@ -9,52 +9,188 @@
 #include "common.hpp"
 
 static int createAnonShm();
-constexpr int n = 2;
 
-ShmBuffer::ShmBuffer(int w, int h, wl_shm_format format)
-	: width(w)
-	, height(h)
-	, stride(w*4)
+ShmBufferStats shmBufferStats;
+
+const wl_buffer_listener ShmBuffer::_bufferListener = {
+	[](void* data, wl_buffer*)
+	{
+		auto buf = static_cast<Buffer*>(data);
+		buf->pool->release(*buf);
+	}
+};
+
+ShmBuffer::ShmBuffer(wl_shm_format format, std::function<void()> onRelease)
+	: _format {format}
+	, _onRelease {std::move(onRelease)}
 {
-	auto oneSize = stride*size_t(h);
-	auto totalSize = oneSize * n;
-	auto fd = createAnonShm();
-	if (fd < 0) {
-		diesys("memfd_create");
+}
+
+ShmBuffer::~ShmBuffer()
+{
+	_buffers.clear();
+	if (_pool) {
+		wl_shm_pool_destroy(_pool);
 	}
-	if (ftruncate(fd, totalSize) < 0) {
-		diesys("ftruncate");
+	if (_fd >= 0) {
+		close(_fd);
 	}
-	auto pool = wl_shm_create_pool(shm, fd, totalSize);
-	auto ptr = reinterpret_cast<uint8_t*>(mmap(nullptr, totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
-	if (!ptr) {
-		diesys("mmap");
+}
+
+void ShmBuffer::resize(uint32_t width, uint32_t height)
+{
+	if (width == _width && height == _height) {
+		return;
 	}
-	_mapping = MemoryMapping {ptr, totalSize};
-	close(fd);
-	for (auto i=0; i<n; i++) {
-		auto offset = oneSize*i;
-		_buffers[i] = {
-			ptr+offset,
-			wl_unique_ptr<wl_buffer> { wl_shm_pool_create_buffer(pool, offset, width, height, stride, format) },
-		};
+	_width = width;
+	_height = height;
+	_stride = width*4;
+	// the compositor may still read the buffers it holds, so their memory stays
+	// untouched until they are released
+	for (auto it = _buffers.begin(); it != _buffers.end(); ) {
+		if (it->busy) {
+			it->retired = true;
+			it++;
+		} else {
+			it = _buffers.erase(it);
+		}
 	}
-	wl_shm_pool_destroy(pool);
 }
 
-uint8_t* ShmBuffer::data()
+ShmBuffer::Buffer* ShmBuffer::acquire()
 {
-	return _buffers[_current].data;
+	auto count = 0;
+	for (auto& buf : _buffers) {
+		if (buf.retired) {
+			continue;
+		}
+		if (!buf.busy) {
+			buf.busy = true;
+			return &buf;
+		}
+		count++;
+	}
+	if (count < maxBuffers) {
+		auto buf = allocate();
+		buf->busy = true;
+		return buf;
+	}
+	shmBufferStats.waits++;
+	_waiting = true;
+	return nullptr;
+}
+
+void ShmBuffer::cancel(Buffer* buf)
+{
+	release(*buf);
 }
 
-wl_buffer* ShmBuffer::buffer()
+bool ShmBuffer::reacquire(Buffer* buf)
 {
-	return _buffers[_current].buffer.get();
+	for (auto& b : _buffers) {
+		if (&b == buf && !b.retired) {
+			// may still be held by the compositor, then it is released only once
+			b.busy = true;
+			return true;
+		}
+	}
+	return false;
 }
 
-void ShmBuffer::flip()
+// places a new buffer in the first gap of the pool that is large enough
+ShmBuffer::Buffer* ShmBuffer::allocate()
 {
-	_current = 1-_current;
+	auto size = _stride*size_t(_height);
+	auto offset = size_t {0};
+	for (auto moved = true; moved; ) {
+		moved = false;
+		for (const auto& buf : _buffers) {
+			if (buf.offset < offset + size && offset < buf.offset + buf.size) {
+				offset = buf.offset + buf.size;
+				moved = true;
+			}
+		}
+	}
+	if (offset + size > _mapping.size()) {
+		growPool(offset + size);
+	}
+
+	auto& buf = _buffers.emplace_back(Buffer {this, offset, size, _width, _height});
+	buf.buffer.reset(wl_shm_pool_create_buffer(_pool, offset, _width, _height, _stride, _format));
+	wl_buffer_add_listener(buf.buffer.get(), &_bufferListener, &buf);
+	createPainter(buf);
+	shmBufferStats.allocations++;
+	return &buf;
+}
+
+void ShmBuffer::createPainter(Buffer& buf)
+{
+	buf.painter.reset();
+	buf.surface.reset(cairo_image_surface_create_for_data(
+		_mapping.ptr() + buf.offset,
+		CAIRO_FORMAT_ARGB32,
+		_width,
+		_height,
+		_stride));
+	buf.painter.reset(cairo_create(buf.surface.get()));
+}
+
+// the pool only ever grows, as wl_shm_pool cannot shrink
+void ShmBuffer::growPool(size_t size)
+{
+	if (_fd < 0) {
+		_fd = createAnonShm();
+		if (_fd < 0) {
+			diesys("memfd_create");
+		}
+	}
+	if (ftruncate(_fd, size) < 0) {
+		diesys("ftruncate");
+	}
+	void* old = _mapping.ptr();
+	void* ptr;
+#if defined(__linux__)
+	if (old) {
+		ptr = mremap(_mapping.ptr(), _mapping.size(), size, MREMAP_MAYMOVE);
+		if (ptr != MAP_FAILED) {
+			_mapping.release();
+		}
+	} else
+#endif
+	{
+		ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	}
+	if (ptr == MAP_FAILED) {
+		diesys("mmap");
+	}
+	auto moved = ptr != old;
+	_mapping = MemoryMapping {ptr, size};
+	if (moved) {
+		// the cairo surfaces point into the old mapping
+		for (auto& buf : _buffers) {
+			if (!buf.retired) {
+				createPainter(buf);
+			}
+		}
+	}
+	if (_pool) {
+		wl_shm_pool_resize(_pool, size);
+	} else {
+		_pool = wl_shm_create_pool(shm, _fd, size);
+	}
+	shmBufferStats.poolGrows++;
+}
+
+void ShmBuffer::release(Buffer& buf)
+{
+	buf.busy = false;
+	if (buf.retired) {
+		_buffers.remove_if([&](const Buffer& b) { return &b == &buf; });
+	}
+	if (_waiting) {
+		_waiting = false;
+		_onRelease();
+	}
 }
 
 #if defined(__linux__)
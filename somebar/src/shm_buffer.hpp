@@ -2,7 +2,8 @@
 // See LICENSE file for copyright and license details.
 
 #pragma once
-#include <array>
+#include <functional>
+#include <list>
 #include <sys/mman.h>
 #include <wayland-client.h>
 #include "common.hpp"
@@ -18,6 +19,10 @@ public:
 	MemoryMapping& operator=(const MemoryMapping& other) = delete;
 	MemoryMapping& operator=(MemoryMapping&& other) { swap(other); return *this; }
 	~MemoryMapping() { if (_ptr) munmap(_ptr, _size); }
+	uint8_t* ptr() const { return static_cast<uint8_t*>(_ptr); }
+	size_t size() const { return _size; }
+	// gives up ownership without unmapping, e.g. after mremap
+	void release() { _ptr = nullptr; _size = 0; }
 	void swap(MemoryMapping &other) {
 		using std::swap;
 		swap(_ptr, other._ptr);
@@ -25,21 +30,76 @@ public:
 	}
 };
 
-// double buffered shm
+struct ShmBufferStats {
+	uint64_t waits;       // frames that found every buffer held by the compositor
+	uint64_t allocations; // wl_buffers created
+	uint64_t poolGrows;   // times the memfd had to grow
+};
+extern ShmBufferStats shmBufferStats;
+
+// pool of up to maxBuffers shm buffers in a single memfd, which grows in place.
 // format is must be 32-bit
+//
+// a buffer is only drawn to once the compositor has released it. Usually one or
+// two buffers are enough, a third one is only allocated when the compositor
+// holds both.
 class ShmBuffer {
-	struct Buf {
-		uint8_t* data {nullptr};
+public:
+	static constexpr int maxBuffers = 3;
+	// lent out by acquire() until the compositor releases it after it was
+	// attached, or until it is handed back with cancel()
+	struct Buffer {
+		ShmBuffer* pool;
+		size_t offset, size;
+		uint32_t width, height;
 		wl_unique_ptr<wl_buffer> buffer;
+		// drawing into the buffer, kept for its whole lifetime
+		wl_unique_ptr<cairo_surface_t> surface;
+		wl_unique_ptr<cairo_t> painter;
+		// the frame the buffer holds, as counted by whoever draws into it. 0 if none.
+		uint64_t frame {0};
+		// where the part of the frame it holds starts, also up to whoever draws into it
+		int origin {0};
+		bool busy {false};
+		// from before a resize, destroyed once released
+		bool retired {false};
 	};
-	std::array<Buf, 2> _buffers;
-	int _current {0};
+private:
+	static const wl_buffer_listener _bufferListener;
+	wl_shm_format _format;
+	std::function<void()> _onRelease;
+	int _fd {-1};
+	wl_shm_pool* _pool {nullptr};
 	MemoryMapping _mapping;
+	std::list<Buffer> _buffers;
+	bool _waiting {false};
+	uint32_t _width {0}, _height {0}, _stride {0};
+
+	Buffer* allocate();
+	void createPainter(Buffer& buf);
+	void growPool(size_t size);
+	void release(Buffer& buf);
 public:
-	const uint32_t width, height, stride;
+	// onRelease is called when a buffer is released after acquire() failed
+	ShmBuffer(wl_shm_format format, std::function<void()> onRelease);
+	ShmBuffer(const ShmBuffer&) = delete;
+	ShmBuffer& operator=(const ShmBuffer&) = delete;
+	~ShmBuffer();
+
+	uint32_t width() const { return _width; }
+	uint32_t height() const { return _height; }
+	uint32_t stride() const { return _stride; }
+	void resize(uint32_t width, uint32_t height);
 
-	explicit ShmBuffer(int width, int height, wl_shm_format format);
-	uint8_t* data();
-	wl_buffer* buffer();
-	void flip();
+	// lends out a buffer that the compositor does not hold. Returns nullptr if
+	// there is none and no more may be allocated. This may move the mapping,
+	// so no buffer may be drawn to while it runs.
+	// the painter of a buffer must be left in the state it was found in, e.g.
+	// with cairo_save and cairo_restore.
+	Buffer* acquire();
+	// hands back a buffer that was not attached
+	void cancel(Buffer* buf);
+	// lends out buf once more, to attach it again with what it held. Returns
+	// false if it was destroyed by a resize.
+	bool reacquire(Buffer* buf);
 };
@@ -0,0 +1,255 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "status_blocks.hpp"
+#include "tokenizer.hpp"
+
+// the blocks read their files with pread on fds that stay open between runs,
+// so a run costs no open/close and no process spawn.
+
+[[gnu::format(printf, 4, 5)]]
+static std::string_view readFile(int& fd, char* buf, size_t size, const char* pathFormat, ...)
+{
+	if (fd < 0) {
+		char path[PATH_MAX];
+		va_list ap;
+		va_start(ap, pathFormat);
+		vsnprintf(path, sizeof(path), pathFormat, ap);
+		va_end(ap);
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			return {};
+		}
+	}
+	auto n = pread(fd, buf, size, 0);
+	if (n < 0) {
+		// the device went away, e.g. an unplugged usb network adapter. open it again next time.
+		close(fd);
+		fd = -1;
+		return {};
+	}
+	return {buf, static_cast<size_t>(n)};
+}
+
+static std::string_view firstLine(std::string_view s)
+{
+	return s.substr(0, s.find('\n'));
+}
+
+[[gnu::format(printf, 2, 3)]]
+static void setText(StatusBlockState& state, const char* format, ...)
+{
+	char buf[128];
+	va_list ap;
+	va_start(ap, format);
+	vsnprintf(buf, sizeof(buf), format, ap);
+	va_end(ap);
+	state.text = buf;
+}
+
+// formats a byte count as 12K, 3.4M etc.
+static void formatBytes(char* buf, size_t size, double bytes)
+{
+	const char* units = "BKMGT";
+	while (bytes >= 1000 && units[1]) {
+		bytes /= 1024;
+		units++;
+	}
+	snprintf(buf, size, bytes < 10 && *units != 'B' ? "%.1f%c" : "%.0f%c", bytes, *units);
+}
+
+void blockClock(StatusBlockState& state, const Arg& arg)
+{
+	auto now = time(nullptr);
+	struct tm tm;
+	char buf[128];
+	if (!localtime_r(&now, &tm) || !strftime(buf, sizeof(buf), static_cast<const char*>(arg.v), &tm)) {
+		state.text.clear();
+		return;
+	}
+	state.text = buf;
+}
+
+// usage since the previous run, from the first line of /proc/stat:
+// cpu user nice system idle iowait irq softirq steal ...
+void blockCpu(StatusBlockState& state, const Arg&)
+{
+	char buf[256];
+	auto tok = Tokenizer {firstLine(readFile(state.fds[0], buf, sizeof(buf), "/proc/stat"))};
+	if (tok.word() != "cpu") {
+		state.text.clear();
+		return;
+	}
+	auto total = uint64_t {0}, idle = uint64_t {0};
+	for (auto i = 0; i < 8; i++) {
+		auto value = uint64_t {0};
+		if (!tok.number(value)) {
+			break;
+		}
+		total += value;
+		if (i == 3 || i == 4) {
+			idle += value;
+		}
+	}
+	auto totalDelta = total - state.prev[0];
+	auto idleDelta = idle - state.prev[1];
+	state.prev[0] = total;
+	state.prev[1] = idle;
+	auto usage = totalDelta ? 100 * (totalDelta - idleDelta) / totalDelta : 0;
+	setText(state, "CPU %d%%", static_cast<int>(usage));
+}
+
+void blockMemory(StatusBlockState& state, const Arg&)
+{
+	char buf[512];
+	auto data = readFile(state.fds[0], buf, sizeof(buf), "/proc/meminfo");
+	auto total = uint64_t {0}, available = uint64_t {0};
+	while (!data.empty() && !(total && available)) {
+		auto line = firstLine(data);
+		data.remove_prefix(std::min(line.size() + 1, data.size()));
+		auto tok = Tokenizer {line};
+		auto key = tok.word();
+		if (key == "MemTotal:") {
+			tok.number(total);
+		} else if (key == "MemAvailable:") {
+			tok.number(available);
+		}
+	}
+	if (!total || available > total) {
+		state.text.clear();
+		return;
+	}
+	setText(state, "MEM %d%%", static_cast<int>(100 * (total - available) / total));
+}
+
+// arg.v is the name of a power supply in /sys/class/power_supply
+void blockBattery(StatusBlockState& state, const Arg& arg)
+{
+	auto name = static_cast<const char*>(arg.v);
+	char buf[32];
+	auto capacity = 0;
+	auto tok = Tokenizer {firstLine(readFile(state.fds[0], buf, sizeof(buf), "/sys/class/power_supply/%s/capacity", name))};
+	if (!tok.number(capacity)) {
+		state.text.clear();
+		return;
+	}
+	auto status = firstLine(readFile(state.fds[1], buf, sizeof(buf), "/sys/class/power_supply/%s/status", name));
+	setText(state, "BAT %d%%%s", capacity, status == "Charging" ? "+" : "");
+}
+
+// arg.v is the name of an interface in /sys/class/net. Shows the throughput
+// since the previous run.
+void blockNetwork(StatusBlockState& state, const Arg& arg)
+{
+	auto name = static_cast<const char*>(arg.v);
+	char buf[32];
+	auto rx = uint64_t {0}, tx = uint64_t {0};
+	auto rxTok = Tokenizer {firstLine(readFile(state.fds[0], buf, sizeof(buf), "/sys/class/net/%s/statistics/rx_bytes", name))};
+	if (!rxTok.number(rx)) {
+		state.text.clear();
+		return;
+	}
+	auto txTok = Tokenizer {firstLine(readFile(state.fds[1], buf, sizeof(buf), "/sys/class/net/%s/statistics/tx_bytes", name))};
+	if (!txTok.number(tx)) {
+		state.text.clear();
+		return;
+	}
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	auto nowMs = static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+	auto rxRate = 0.0, txRate = 0.0;
+	if (state.prev[2] && nowMs > state.prev[2] && rx >= state.prev[0] && tx >= state.prev[1]) {
+		auto seconds = (nowMs - state.prev[2]) / 1000.0;
+		rxRate = (rx - state.prev[0]) / seconds;
+		txRate = (tx - state.prev[1]) / seconds;
+	}
+	state.prev[0] = rx;
+	state.prev[1] = tx;
+	state.prev[2] = nowMs;
+	char rxText[16], txText[16];
+	formatBytes(rxText, sizeof(rxText), rxRate);
+	formatBytes(txText, sizeof(txText), txRate);
+	setText(state, "rx %s tx %s", rxText, txText);
+}
+
+StatusBlocks::StatusBlocks(EventLoop& loop, const std::vector<StatusBlock>& blocks, std::string_view separator, std::function<void(std::string_view)> update)
+	: _loop {loop}, _separator {separator}, _update {std::move(update)}
+{
+	_blocks.reserve(blocks.size());
+	for (const auto& config : blocks) {
+		_blocks.push_back(Block {&config, {}, -1});
+	}
+}
+
+StatusBlocks::~StatusBlocks()
+{
+	for (auto& block : _blocks) {
+		if (block.timerFd >= 0) {
+			_loop.removeTimer(block.timerFd);
+		}
+		for (auto fd : block.state.fds) {
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+	}
+}
+
+void StatusBlocks::start()
+{
+	for (auto i = size_t {0}; i < _blocks.size(); i++) {
+		auto& block = _blocks[i];
+		block.config->func(block.state, block.config->arg);
+		block.timerFd = _loop.addTimer(CLOCK_REALTIME, [this, i]() { run(_blocks[i]); });
+		arm(block);
+	}
+	join();
+}
+
+void StatusBlocks::run(Block& block)
+{
+	auto previous = block.state.text;
+	block.config->func(block.state, block.config->arg);
+	arm(block);
+	if (block.state.text != previous) {
+		join();
+	}
+}
+
+// arms the block's timer for the next multiple of its interval since the epoch,
+// so a clock with an interval of 60 changes right at the minute. The timer is
+// cancelled when the clock is set, which runs the block and re-arms it.
+void StatusBlocks::arm(Block& block)
+{
+	auto interval = std::max(block.config->interval, 1);
+	timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	auto next = timespec {(now.tv_sec / interval + 1) * interval, 0};
+	_loop.armTimer(block.timerFd, next, {}, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET);
+}
+
+void StatusBlocks::join()
+{
+	auto text = std::string {};
+	for (const auto& block : _blocks) {
+		if (block.state.text.empty()) {
+			continue;
+		}
+		if (!text.empty()) {
+			text += _separator;
+		}
+		text += block.state.text;
+	}
+	if (text != _text) {
+		_text = std::move(text);
+		_update(_text);
+	}
+}
@@ -0,0 +1,37 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "common.hpp"
+#include "event_loop.hpp"
+
+// runs the status blocks from config.hpp on event loop timers, and passes the
+// text of all blocks to the callback whenever one of them changes.
+class StatusBlocks {
+	struct Block {
+		const StatusBlock* config;
+		StatusBlockState state;
+		int timerFd {-1};
+	};
+	EventLoop& _loop;
+	std::vector<Block> _blocks;
+	std::string_view _separator;
+	std::function<void(std::string_view)> _update;
+	std::string _text;
+
+	void run(Block& block);
+	void arm(Block& block);
+	void join();
+public:
+	StatusBlocks(EventLoop& loop, const std::vector<StatusBlock>& blocks, std::string_view separator, std::function<void(std::string_view)> update);
+	StatusBlocks(const StatusBlocks&) = delete;
+	StatusBlocks& operator=(const StatusBlocks&) = delete;
+	~StatusBlocks();
+
+	// runs every block once, then on its interval
+	void start();
+};
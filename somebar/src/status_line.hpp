@@ -0,0 +1,52 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include "tokenizer.hpp"
+
+// the lines dwl sends in printstatus(), e.g. "DP-1 tags 1 2 0 0"
+enum class StatusLineType { Title, Selmon, Tags, Layout, Other };
+struct StatusLine {
+	StatusLineType type {StatusLineType::Other};
+	// all views point into the parsed line
+	std::string_view monitor;
+	// Title and Layout: the rest of the line
+	std::string_view text;
+	uint32_t selected {0};
+	uint32_t occupied {0}, tags {0}, clientTags {0}, urgent {0};
+};
+
+// returns nullopt for lines without a command, or with malformed numbers.
+// this does not allocate and does not touch any wayland state.
+inline std::optional<StatusLine> parseStatusLine(std::string_view line)
+{
+	auto tokens = Tokenizer {line};
+	auto res = StatusLine {};
+	res.monitor = tokens.word();
+	auto command = tokens.word();
+	if (command.empty()) {
+		return std::nullopt;
+	}
+	if (command == "title") {
+		res.type = StatusLineType::Title;
+		res.text = tokens.rest();
+	} else if (command == "selmon") {
+		res.type = StatusLineType::Selmon;
+		if (!tokens.number(res.selected)) {
+			return std::nullopt;
+		}
+	} else if (command == "tags") {
+		res.type = StatusLineType::Tags;
+		if (!tokens.number(res.occupied) || !tokens.number(res.tags)
+			|| !tokens.number(res.clientTags) || !tokens.number(res.urgent)) {
+			return std::nullopt;
+		}
+	} else if (command == "layout") {
+		res.type = StatusLineType::Layout;
+		res.text = tokens.rest();
+	}
+	return res;
+}
@@ -0,0 +1,154 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+
+// dwl writes its status as text lines by default. If dwl offers binary records
+// in DWL_STATUS_FORMATS, the bar can accept them by writing statusBinaryReply to
+// the fd in DWL_STATUS_REPLY_FD. dwl then writes statusBinarySwitch as a text
+// line, and everything after it is a sequence of records:
+//
+//   uint32 size                        bytes following this field
+//   uint32 kind                        StatusRecordKind
+//   uint32 occupied, tags, clientTags, urgent
+//   uint32 flags                       StatusRecordFlags
+//   uint32 nameLen, layoutLen, titleLen, appidLen
+//   char   name[], layout[], title[], appid[]  UTF-8, not NUL-terminated
+//
+// all integers are in host byte order, as both ends run on the same machine.
+constexpr std::string_view statusBinaryOffer {"binary1"};
+constexpr std::string_view statusBinaryReply {"binary 1\n"};
+constexpr std::string_view statusBinarySwitch {"\0binary 1", 9};
+
+enum StatusRecordKind : uint32_t { StatusRecordMonitor = 1 };
+enum StatusRecordFlags : uint32_t {
+	StatusSelected = 0x01,
+	StatusHasClient = 0x02,
+	StatusFullscreen = 0x04,
+	StatusFloating = 0x08,
+};
+
+struct StatusRecord {
+	uint32_t kind;
+	uint32_t occupied, tags, clientTags, urgent;
+	uint32_t flags;
+	// point into the RecordBuffer, only valid during the consumer call
+	std::string_view name, layout, title, appid;
+};
+
+// reads length-prefixed StatusRecords from Reader, and passes them to Consumer.
+// the buffer grows to fit the largest record, up to MaxRecordSize.
+class RecordBuffer {
+	static constexpr size_t MaxRecordSize = 1 << 20;
+	static constexpr size_t FixedSize = 10 * sizeof(uint32_t);
+	std::vector<char> _buffer;
+	size_t _bufferedTo {0};
+	size_t _consumedTo {0};
+public:
+	RecordBuffer() : _buffer(4096) { }
+
+	// appends bytes that were read ahead by someone else, e.g. a LineBuffer
+	void append(std::string_view data)
+	{
+		reserve(data.size());
+		std::memcpy(_buffer.data() + _bufferedTo, data.data(), data.size());
+		_bufferedTo += data.size();
+	}
+
+	// returns the result of the last read, or -1 with errno = EPROTO on a malformed record
+	template<typename Reader, typename Consumer>
+	ssize_t readRecords(const Reader& reader, const Consumer& consumer)
+	{
+		// dispatch what append() left us first
+		if (!dispatchRecords(consumer)) {
+			errno = EPROTO;
+			return -1;
+		}
+		while (true) {
+			reserve(1);
+			auto bytesRead = reader(_buffer.data() + _bufferedTo, _buffer.size() - _bufferedTo);
+			if (bytesRead <= 0) {
+				return bytesRead;
+			}
+			_bufferedTo += bytesRead;
+			if (!dispatchRecords(consumer)) {
+				errno = EPROTO;
+				return -1;
+			}
+		}
+	}
+private:
+	static uint32_t readU32(const char* p)
+	{
+		uint32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	template<typename Consumer>
+	bool dispatchRecords(const Consumer& consumer)
+	{
+		while (_bufferedTo - _consumedTo >= sizeof(uint32_t)) {
+			auto p = _buffer.data() + _consumedTo;
+			auto size = readU32(p);
+			if (size < FixedSize || size > MaxRecordSize) {
+				return false;
+			}
+			if (_bufferedTo - _consumedTo < sizeof(uint32_t) + size) {
+				break;
+			}
+			p += sizeof(uint32_t);
+			auto rec = StatusRecord {};
+			rec.kind = readU32(p);
+			rec.occupied = readU32(p + 4);
+			rec.tags = readU32(p + 8);
+			rec.clientTags = readU32(p + 12);
+			rec.urgent = readU32(p + 16);
+			rec.flags = readU32(p + 20);
+			uint32_t lengths[4];
+			auto total = uint64_t {FixedSize};
+			for (auto i = 0; i < 4; i++) {
+				lengths[i] = readU32(p + 24 + i*4);
+				total += lengths[i];
+			}
+			if (total != size) {
+				return false;
+			}
+			auto str = p + FixedSize;
+			std::string_view* fields[] = {&rec.name, &rec.layout, &rec.title, &rec.appid};
+			for (auto i = 0; i < 4; i++) {
+				*fields[i] = {str, lengths[i]};
+				str += lengths[i];
+			}
+			_consumedTo += sizeof(uint32_t) + size;
+			consumer(rec);
+		}
+		if (_consumedTo == _bufferedTo) {
+			_consumedTo = _bufferedTo = 0;
+		}
+		return true;
+	}
+
+	// makes room for at least n more bytes after _bufferedTo
+	void reserve(size_t n)
+	{
+		if (_buffer.size() - _bufferedTo >= n) {
+			return;
+		}
+		if (_consumedTo > 0) {
+			std::memmove(_buffer.data(), _buffer.data() + _consumedTo, _bufferedTo - _consumedTo);
+			_bufferedTo -= _consumedTo;
+			_consumedTo = 0;
+		}
+		if (_buffer.size() - _bufferedTo < n) {
+			_buffer.resize(std::max(_buffer.size() * 2, _bufferedTo + n));
+		}
+	}
+};
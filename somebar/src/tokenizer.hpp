@@ -0,0 +1,56 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <charconv>
+#include <string_view>
+
+// splits a line into whitespace-separated words without copying it.
+// all returned views point into the line passed to the constructor.
+class Tokenizer {
+	std::string_view _rest;
+
+	static bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+	void skipSpace()
+	{
+		auto i = size_t {0};
+		while (i < _rest.size() && isSpace(_rest[i])) {
+			i++;
+		}
+		_rest.remove_prefix(i);
+	}
+public:
+	explicit Tokenizer(std::string_view line) : _rest {line} { }
+
+	// returns the next word, or an empty view if the line is exhausted
+	std::string_view word()
+	{
+		skipSpace();
+		auto i = size_t {0};
+		while (i < _rest.size() && !isSpace(_rest[i])) {
+			i++;
+		}
+		auto res = _rest.substr(0, i);
+		_rest.remove_prefix(i);
+		return res;
+	}
+
+	// parses the next word as an integer. returns false if it is missing or malformed.
+	template<typename T>
+	bool number(T& value)
+	{
+		auto w = word();
+		auto [end, ec] = std::from_chars(w.data(), w.data() + w.size(), value);
+		return ec == std::errc {} && end == w.data() + w.size() && !w.empty();
+	}
+
+	// returns the rest of the line, without leading whitespace
+	std::string_view rest()
+	{
+		skipSpace();
+		return _rest;
+	}
+};
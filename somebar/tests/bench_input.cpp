@@ -0,0 +1,88 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+// measures the throughput of the input path, LineBuffer together with
+// parseStatusLine() or parseCommand(), and counts the heap allocations it makes.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include "command.hpp"
+#include "line_buffer.hpp"
+#include "status_line.hpp"
+#include "traffic.hpp"
+
+static size_t allocations;
+
+void* operator new(size_t size)
+{
+	allocations++;
+	if (auto p = malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc {};
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+using InputBuffer = LineBuffer<512, 64*1024>;
+
+// runs data through a fresh buffer in reads of chunk bytes, rounds times
+template<typename Parser>
+static void run(const char* name, const std::string& data, size_t lineCount, size_t chunk, Parser parser)
+{
+	constexpr auto rounds = 20000;
+	// keeps the compiler from dropping the parsing
+	static volatile uint32_t sink;
+	auto buffer = InputBuffer {};
+	auto consumer = [&](const char* p, size_t size) { sink = sink + parser(std::string_view {p, size}); };
+	auto feedAll = [&]() {
+		for (auto view = std::string_view {data}; !view.empty(); view.remove_prefix(std::min(chunk, view.size()))) {
+			feed(buffer, view.substr(0, chunk), consumer);
+		}
+	};
+	// the buffer grows to fit the longest line once, that is not counted
+	feedAll();
+	auto allocationsBefore = allocations;
+	auto start = std::chrono::steady_clock::now();
+	for (auto round = 0; round < rounds; round++) {
+		feedAll();
+	}
+	auto seconds = std::chrono::duration<double> {std::chrono::steady_clock::now() - start}.count();
+	auto lines = double(rounds) * lineCount;
+	printf("%-28s %5zu B reads  %12.0f lines/s  %8.1f MB/s  %6.3f allocations/line\n",
+		name, chunk, lines / seconds, rounds * data.size() / seconds / 1e6,
+		(allocations - allocationsBefore) / lines);
+}
+
+static uint32_t statusLine(std::string_view line)
+{
+	auto parsed = parseStatusLine(line);
+	return parsed ? parsed->text.size() + parsed->tags + parsed->selected : 0;
+}
+
+static uint32_t command(std::string_view line)
+{
+	auto parsed = parseCommand(line);
+	return parsed ? parsed->arg.size() : 0;
+}
+
+int main()
+{
+	auto dwl = printstatusBurst(3);
+	auto dwlLong = printstatusBurst(3, 1000);
+	auto fifo = fifoCommands(3);
+	auto dwlData = joinLines(dwl);
+	auto dwlLongData = joinLines(dwlLong);
+	auto fifoData = joinLines(fifo);
+	for (auto chunk : {size_t {7}, size_t {64}, size_t {4096}}) {
+		run("stdin, 3 monitors", dwlData, dwl.size(), chunk, statusLine);
+		run("stdin, 1000 byte titles", dwlLongData, dwlLong.size(), chunk, statusLine);
+		run("status fifo", fifoData, fifo.size(), chunk, command);
+	}
+	return 0;
+}
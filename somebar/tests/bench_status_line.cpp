@@ -0,0 +1,82 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+// measures how many dwl status lines per second parseStatusLine() handles,
+// next to the istringstream parser it replaced.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "status_line.hpp"
+#include "traffic.hpp"
+
+// the parser before the tokenizer, with the same results as parseStatusLine()
+static uint32_t parseWithStream(const std::string& line)
+{
+	std::string monName, command;
+	auto stream = std::istringstream {line};
+	stream >> monName >> command;
+	if (!stream.good()) {
+		return 0;
+	}
+	if (command == "title" || command == "layout") {
+		auto text = std::string {};
+		stream >> std::ws;
+		std::getline(stream, text);
+		return text.size();
+	} else if (command == "selmon") {
+		uint32_t selected;
+		stream >> selected;
+		return selected;
+	} else if (command == "tags") {
+		uint32_t occupied, tags, clientTags, urgent;
+		stream >> occupied >> tags >> clientTags >> urgent;
+		return occupied + tags + clientTags + urgent;
+	}
+	return 0;
+}
+
+static uint32_t parseWithTokenizer(const std::string& line)
+{
+	auto parsed = parseStatusLine(line);
+	if (!parsed) {
+		return 0;
+	}
+	return parsed->text.size() + parsed->selected
+		+ parsed->occupied + parsed->tags + parsed->clientTags + parsed->urgent;
+}
+
+template<typename Parser>
+static double linesPerSecond(const std::vector<std::string>& lines, Parser parser)
+{
+	constexpr auto rounds = 200000;
+	// keeps the compiler from dropping the parsing
+	static volatile uint32_t sink;
+	auto start = std::chrono::steady_clock::now();
+	for (auto round = 0; round < rounds; round++) {
+		for (const auto& line : lines) {
+			sink = sink + parser(line);
+		}
+	}
+	auto seconds = std::chrono::duration<double> {std::chrono::steady_clock::now() - start}.count();
+	return rounds * lines.size() / seconds;
+}
+
+int main()
+{
+	auto lines = printstatusBurst(3);
+	for (const auto& line : lines) {
+		if (parseWithStream(line) != parseWithTokenizer(line)) {
+			fprintf(stderr, "parsers disagree on: %s\n", line.c_str());
+			return 1;
+		}
+	}
+	auto before = linesPerSecond(lines, parseWithStream);
+	auto after = linesPerSecond(lines, parseWithTokenizer);
+	printf("istringstream:   %12.0f lines/s\n", before);
+	printf("parseStatusLine: %12.0f lines/s (%.1fx)\n", after, after / before);
+	return 0;
+}
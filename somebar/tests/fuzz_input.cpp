@@ -0,0 +1,49 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+// libFuzzer harness for the input path. The first byte of the input picks
+// where it is split into two reads, the rest goes through LineBuffer, and every
+// line through parseStatusLine() and parseCommand().
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "command.hpp"
+#include "line_buffer.hpp"
+#include "status_line.hpp"
+#include "traffic.hpp"
+
+// small buffers, so the fuzzer reaches the growing and discarding paths quickly
+using InputBuffer = LineBuffer<16, 256>;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	if (size == 0) {
+		return 0;
+	}
+	auto input = std::string_view {reinterpret_cast<const char*>(data) + 1, size - 1};
+	auto split = std::min(static_cast<size_t>(data[0]), input.size());
+	auto buffer = InputBuffer {};
+	auto consumer = [](const char* p, size_t n) {
+		auto line = std::string_view {p, n};
+		if (auto parsed = parseStatusLine(line)) {
+			// every view must point into the line
+			for (auto field : {parsed->monitor, parsed->text}) {
+				if (!field.empty() && (field.data() < line.data()
+					|| field.data() + field.size() > line.data() + line.size())) {
+					__builtin_trap();
+				}
+			}
+		}
+		if (auto cmd = parseCommand(line)) {
+			if (cmd->arg.data() + cmd->arg.size() != line.data() + line.size()) {
+				__builtin_trap();
+			}
+		}
+		parseQuery(line);
+	};
+	feed(buffer, input.substr(0, split), consumer);
+	feed(buffer, input.substr(split), consumer);
+	buffer.takeBuffered();
+	return 0;
+}
@@ -0,0 +1,148 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+// checks the input path, LineBuffer, parseStatusLine() and parseCommand(),
+// against synthetic dwl and fifo traffic, split into reads at every byte offset.
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "command.hpp"
+#include "line_buffer.hpp"
+#include "status_line.hpp"
+#include "traffic.hpp"
+
+static int failures;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+	} while (0)
+
+// the buffers main.cpp reads stdin and the status fifo with
+using InputBuffer = LineBuffer<512, 64*1024>;
+
+// feeds data in two reads split at every offset, and in reads of every size up
+// to maxChunk, and checks that exactly lines come out each time
+static void checkSplits(const std::vector<std::string>& lines, size_t maxChunk)
+{
+	auto data = joinLines(lines);
+	auto check = [&](const std::vector<std::string_view>& pieces, const char* how, size_t n) {
+		auto buffer = InputBuffer {};
+		auto got = std::vector<std::string> {};
+		for (auto piece : pieces) {
+			feed(buffer, piece, [&](const char* p, size_t size) { got.emplace_back(p, size); });
+		}
+		if (got != lines) {
+			fprintf(stderr, "wrong lines with %s %zu\n", how, n);
+			failures++;
+		}
+	};
+	for (auto offset = size_t {0}; offset <= data.size(); offset++) {
+		auto view = std::string_view {data};
+		check({view.substr(0, offset), view.substr(offset)}, "split at", offset);
+	}
+	for (auto chunk = size_t {1}; chunk <= maxChunk; chunk++) {
+		auto pieces = std::vector<std::string_view> {};
+		for (auto view = std::string_view {data}; !view.empty(); view.remove_prefix(std::min(chunk, view.size()))) {
+			pieces.push_back(view.substr(0, chunk));
+		}
+		check(pieces, "reads of", chunk);
+	}
+}
+
+static void testLineBuffer()
+{
+	// many monitors, and titles longer than the initial buffer
+	checkSplits(printstatusBurst(8), 64);
+	checkSplits(printstatusBurst(2, 2000), 700);
+	checkSplits(fifoCommands(4), 16);
+
+	// a line longer than the largest buffer is dropped, the next one is kept
+	auto buffer = InputBuffer {};
+	auto got = std::vector<std::string> {};
+	auto consumer = [&](const char* p, size_t size) { got.emplace_back(p, size); };
+	feed(buffer, std::string(100*1024, 'x') + "\nDP-1 selmon 1\n", consumer);
+	CHECK(got.size() == 1 && got[0] == "DP-1 selmon 1");
+
+	// a consumer that returns false leaves the rest in the buffer
+	auto stopping = InputBuffer {};
+	auto count = 0;
+	feed(stopping, "one\ntwo\nthree", [&](const char*, size_t) { return ++count < 1; });
+	CHECK(count == 1);
+	CHECK(stopping.takeBuffered() == "two\nthree");
+}
+
+static void testStatusLine()
+{
+	auto title = parseStatusLine("DP-1 title  vim  main.cpp ");
+	CHECK(title && title->type == StatusLineType::Title);
+	CHECK(title && title->monitor == "DP-1" && title->text == "vim  main.cpp ");
+
+	auto tags = parseStatusLine("HDMI-A-1 tags 23 2 2 1");
+	CHECK(tags && tags->type == StatusLineType::Tags);
+	CHECK(tags && tags->occupied == 23 && tags->tags == 2 && tags->clientTags == 2 && tags->urgent == 1);
+
+	auto selmon = parseStatusLine("DP-1\tselmon\t1");
+	CHECK(selmon && selmon->type == StatusLineType::Selmon && selmon->selected == 1);
+
+	auto layout = parseStatusLine("DP-1 layout [M]");
+	CHECK(layout && layout->type == StatusLineType::Layout && layout->text == "[M]");
+
+	auto emptyTitle = parseStatusLine("DP-1 title");
+	CHECK(emptyTitle && emptyTitle->type == StatusLineType::Title && emptyTitle->text.empty());
+
+	auto other = parseStatusLine("DP-1 fullscreen 0");
+	CHECK(other && other->type == StatusLineType::Other && other->monitor == "DP-1");
+
+	CHECK(!parseStatusLine(""));
+	CHECK(!parseStatusLine("DP-1"));
+	CHECK(!parseStatusLine("DP-1 selmon"));
+	CHECK(!parseStatusLine("DP-1 selmon yes"));
+	CHECK(!parseStatusLine("DP-1 tags 1 2 3"));
+	CHECK(!parseStatusLine("DP-1 tags 1 2 3 4x"));
+	CHECK(!parseStatusLine("DP-1 tags 1 2 3 99999999999"));
+
+	// everything printstatus() sends parses
+	for (const auto& line : printstatusBurst(3)) {
+		CHECK(parseStatusLine(line).has_value());
+	}
+}
+
+static void testCommand()
+{
+	auto status = parseCommand("status  cpu 4% | mem 31%");
+	CHECK(status && status->type == CommandType::Status && status->arg == " cpu 4% | mem 31%");
+
+	auto toggle = parseCommand("toggle all");
+	CHECK(toggle && toggle->type == CommandType::Toggle && toggle->arg == argAll);
+
+	auto show = parseCommand("show DP-1");
+	CHECK(show && show->type == CommandType::Show && show->arg == "DP-1");
+
+	auto hide = parseCommand("hide selected");
+	CHECK(hide && hide->type == CommandType::Hide && hide->arg == argSelected);
+
+	CHECK(!parseCommand(""));
+	CHECK(!parseCommand("status"));
+	CHECK(!parseCommand("toggleall"));
+	CHECK(!parseCommand("bogus command"));
+
+	CHECK(parseQuery("get stats") == Query::Stats);
+	CHECK(!parseQuery("get stats "));
+}
+
+int main()
+{
+	testLineBuffer();
+	testStatusLine();
+	testCommand();
+	if (failures) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
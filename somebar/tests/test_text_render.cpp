@@ -0,0 +1,113 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+// draws Latin strings once shaped by LayoutStore::shapeSimple() and once by a
+// pango layout, and checks that the pixels are the same. On a mismatch, both
+// images are written to the current directory.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <pango/pangocairo.h>
+#include "layout_store.hpp"
+
+[[noreturn]] void die(const char* why)
+{
+	fprintf(stderr, "error: %s failed, aborting\n", why);
+	exit(1);
+}
+
+// what the bar shows most: tags, layout symbols, status blocks, and Latin
+// text with kerning pairs, ligatures and accents
+constexpr const char* strings[] = {
+	"1", "2", "9", "[]=", "><>", "[M]", "tle", "mon",
+	"cpu 4%  |  mem 31%  |  bat 87%",
+	"Fri 16 Oct 20:22",
+	"AVATAR Wave To. Yo, LT fi fl ffi",
+	"somebar - dwl bar ~/src/somebar/src/main.cpp",
+	"Ærøskøbing café, Łódź, Ğüneş, São Paulo",
+	"\"quotes\" 'and' (brackets) {braces} <angles> @#$&*_+=",
+};
+constexpr const char* fonts[] = {"Sans 12", "Serif 11", "Monospace 10"};
+// in 120ths, like the bar's scale
+constexpr int scales[] = {120, 150, 240};
+constexpr int pad = 4;
+
+static wl_unique_ptr<cairo_surface_t> draw(const SharedLayout& layout, int width, int height)
+{
+	auto surface = wl_unique_ptr<cairo_surface_t> {cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height)};
+	auto painter = wl_unique_ptr<cairo_t> {cairo_create(surface.get())};
+	cairo_set_source_rgb(painter.get(), 1, 1, 1);
+	cairo_paint(painter.get());
+	cairo_set_source_rgb(painter.get(), 0, 0, 0);
+	cairo_move_to(painter.get(), pad, pad);
+	layout.draw(painter.get());
+	painter.reset();
+	cairo_surface_flush(surface.get());
+	return surface;
+}
+
+static int countDifferentPixels(cairo_surface_t* a, cairo_surface_t* b)
+{
+	auto width = cairo_image_surface_get_width(a);
+	auto height = cairo_image_surface_get_height(a);
+	auto stride = cairo_image_surface_get_stride(a);
+	auto pa = cairo_image_surface_get_data(a);
+	auto pb = cairo_image_surface_get_data(b);
+	auto count = 0;
+	for (auto y = 0; y < height; y++) {
+		for (auto x = 0; x < width; x++) {
+			count += memcmp(pa + y*stride + x*4, pb + y*stride + x*4, 4) != 0;
+		}
+	}
+	return count;
+}
+
+int main()
+{
+	auto compared = 0;
+	auto failures = 0;
+	for (auto fontName : fonts) {
+		for (auto scale : scales) {
+			auto desc = pango_font_description_from_string(fontName);
+			pango_font_description_set_size(desc, pango_font_description_get_size(desc) * scale / 120);
+			auto fast = LayoutStore {desc, true};
+			auto pango = LayoutStore {desc, false};
+			for (auto text : strings) {
+				auto fastLayout = fast.get(text);
+				auto pangoLayout = pango.get(text);
+				if (!fastLayout->glyphs) {
+					// the font lacks a glyph, so both go through pango
+					printf("not shaped by harfbuzz: %s at %d: %s\n", fontName, scale, text);
+					continue;
+				}
+				compared++;
+				int width, height;
+				pango_layout_get_pixel_size(pangoLayout->pangoLayout.get(), &width, &height);
+				auto ok = fastLayout->width() == pangoLayout->width();
+				auto canvasWidth = std::max(fastLayout->width(), pangoLayout->width()) + pad*2;
+				auto a = draw(*fastLayout, canvasWidth, height + pad*2);
+				auto b = draw(*pangoLayout, canvasWidth, height + pad*2);
+				auto different = countDifferentPixels(a.get(), b.get());
+				if (ok && !different) {
+					continue;
+				}
+				failures++;
+				fprintf(stderr, "%s at %d: \"%s\": width %d, pango %d, %d pixels differ\n",
+					fontName, scale, text, fastLayout->width(), pangoLayout->width(), different);
+				auto name = "text_render_" + std::to_string(failures);
+				cairo_surface_write_to_png(a.get(), (name + "_harfbuzz.png").c_str());
+				cairo_surface_write_to_png(b.get(), (name + "_pango.png").c_str());
+			}
+			pango_font_description_free(desc);
+		}
+	}
+	printf("compared %d strings, %d differ\n", compared, failures);
+	if (!compared) {
+		// no usable font, skip
+		return 77;
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+// synthetic input for the tests and benchmarks of the input path
+
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+
+// what printstatus() sends for every monitor on a focus change
+inline std::vector<std::string> printstatusBurst(int monitors, size_t titleLength = 48)
+{
+	auto title = std::string {};
+	while (title.size() < titleLength) {
+		title += "somebar - dwl bar ~/src/somebar/src/main.cpp ";
+	}
+	title.resize(titleLength);
+	auto lines = std::vector<std::string> {};
+	for (auto i = 0; i < monitors; i++) {
+		auto name = "DP-" + std::to_string(i + 1);
+		lines.push_back(name + " title " + title);
+		lines.push_back(name + " appid foot");
+		lines.push_back(name + " fullscreen 0");
+		lines.push_back(name + " floating 0");
+		lines.push_back(name + " selmon " + (i == 0 ? "1" : "0"));
+		lines.push_back(name + " tags 23 2 2 0");
+		lines.push_back(name + " layout []=");
+	}
+	return lines;
+}
+
+// what scripts and somebar -c write to the status fifo
+inline std::vector<std::string> fifoCommands(int monitors)
+{
+	auto lines = std::vector<std::string> {};
+	for (auto i = 0; i < monitors; i++) {
+		auto name = "DP-" + std::to_string(i + 1);
+		lines.push_back("status cpu 4%  |  mem 31%  |  bat 87%  |  Fri 16 Oct 20:22");
+		lines.push_back("toggle " + name);
+		lines.push_back("hide " + name);
+		lines.push_back("show " + name);
+	}
+	lines.push_back("toggle all");
+	lines.push_back("show selected");
+	lines.push_back("bogus command");
+	return lines;
+}
+
+inline std::string joinLines(const std::vector<std::string>& lines)
+{
+	auto res = std::string {};
+	for (const auto& line : lines) {
+		res += line;
+		res += '\n';
+	}
+	return res;
+}
+
+// passes data to readLines() like one wakeup of a non-blocking pipe: the
+// reads return data until it runs out, and then fail with EAGAIN
+template<typename Buffer, typename Consumer>
+ssize_t feed(Buffer& buffer, std::string_view data, const Consumer& consumer)
+{
+	return buffer.readLines([&](void* p, size_t size) -> ssize_t {
+		if (data.empty()) {
+			errno = EAGAIN;
+			return -1;
+		}
+		auto n = std::min(size, data.size());
+		std::memcpy(p, data.data(), n);
+		data.remove_prefix(n);
+		return n;
+	}, consumer);
+}